@@ -12,6 +12,10 @@
 #include <linux/ktime.h>
 #include <linux/dma-mapping.h>
 #include <linux/swapops.h>
+#include <linux/bitmap.h>
+#include <linux/highmem.h>
+#include <linux/sort.h>
+#include <kunit/static_stub.h>
 #include <asm/tlbflush.h>
 #include "internal.h"
 
@@ -44,9 +48,27 @@ struct dpu_compact_region *dpu_compact_region_create(unsigned long base_pfn, uns
         return NULL;
     }
 
+    region->dst_map = bitmap_zalloc(size, GFP_KERNEL);
+    if (!region->dst_map) {
+        kfree(region->dpu_buffer);
+        kfree(region->dpu_addr_list);
+        kfree(region);
+        return NULL;
+    }
+
     return region;
 }
 
+void dpu_compact_region_destroy(struct dpu_compact_region *region)
+{
+    if (region->dpu_buffer)
+        kfree(region->dpu_buffer);
+    if (region->dpu_addr_list)
+        kfree(region->dpu_addr_list);
+    bitmap_free(region->dst_map);
+    kfree(region);
+}
+
 /* --- 2. 页面适用性检查 --- */
 bool dpu_compact_page_suitable(struct page *page)
 {
@@ -91,6 +113,12 @@ int dpu_compact_add_fragment(struct dpu_compact_region *region,
     frag->is_frag = is_frag;
     frag->anon_vma = NULL;
 
+    /* 放置策略用到的属性在隔离时采样，规划阶段不再访问 struct page */
+    frag->migratetype = get_pageblock_migratetype(page);
+    frag->is_hot = PageActive(page) || PageReferenced(page);
+    frag->owner = is_frag ? folio_raw_mapping(page_folio(page)) : NULL;
+    frag->memcg_id = is_frag ? dpu_page_memcg_id(page) : 0;
+
     /* 不需要记录单个 VMA，migration entry 会处理所有映射 */
     frag->is_mapped = false;
     frag->vaddr = 0;
@@ -130,14 +158,24 @@ static unsigned long dpu_compact_isolate_buddy_page(struct dpu_compact_region *r
     }
     spin_unlock_irqrestore(&zone->lock, flags);
 
+    /* split_map_pages() 从 page_private 读取 order */
+    set_page_private(page, order);
     INIT_LIST_HEAD(&free_list);
     list_add(&page->lru, &free_list);
 
     split_map_pages(&free_list);
 
+    /*
+     * buddy 块可能比区域大（最大 order 的块是区域的两倍），区域外的
+     * 子页直接放回，规划器只认识区域内的槽位
+     */
     list_for_each_entry_safe(split_page, tmp, &free_list, lru) {
+        unsigned long pfn = page_to_pfn(split_page);
+
         list_del(&split_page->lru);
-        if (taken < remaining_space && 
+        if (taken < remaining_space &&
+            pfn >= region->base_pfn &&
+            pfn < region->base_pfn + region->region_size &&
             dpu_compact_add_fragment(region, split_page, NULL, 0, false) == 0) {
             taken++;
         } else {
@@ -175,6 +213,10 @@ int dpu_compact_isolate_pages(struct zone *zone, struct dpu_compact_region *regi
             continue;
 
         if (PageLRU(page)) {
+            /* 未 opt-in 的其他 memcg 的页不动，避免替别人付 rmap 开销 */
+            if (!dpu_memcg_may_move(region->memcg_id, dpu_page_memcg_id(page)))
+                continue;
+
             if (isolate_lru_page(page) != 0)
                 continue;
 
@@ -194,15 +236,85 @@ int dpu_compact_isolate_pages(struct zone *zone, struct dpu_compact_region *regi
     return isolated;
 }
 
+/*
+ * 快速路径：未映射的干净文件页直接从 page cache 丢弃，不再拷贝。
+ * 需要时再从文件读回，比 DPU 拷贝加 xarray 更新便宜。
+ */
+static bool dpu_compact_drop_clean(struct dpu_fragment *frag)
+{
+    struct folio *folio = page_folio(frag->page);
+    struct address_space *mapping = folio_mapping(folio);
+
+    /* shmem 页是 swapbacked，丢弃就丢数据 */
+    if (!mapping || folio_test_anon(folio) || folio_test_swapbacked(folio))
+        return false;
+
+    if (folio_mapped(folio) || folio_test_dirty(folio) ||
+        folio_test_writeback(folio))
+        return false;
+
+    if (folio_test_private(folio) && !filemap_release_folio(folio, 0))
+        return false;
+
+    /* 成功后只剩 isolate_lru_page() 的那次引用 */
+    if (!remove_mapping(mapping, folio))
+        return false;
+
+    /* 已脱离 LRU，PG_active 不会再被清掉，释放前手动清除 */
+    folio_clear_active(folio);
+    folio_unlock(folio);
+    folio_put(folio);
+
+    return true;
+}
+
+/* 真碎片且目标位置不同才需要拷贝 */
+static inline bool dpu_fragment_needs_copy(struct dpu_fragment *frag)
+{
+    return frag->is_frag && frag->old_pfn != frag->new_pfn;
+}
+
+/*
+ * 规划后再丢弃：只丢会被拷贝的冷碎片，留在原地的页和热页不动。
+ * 丢弃的页直接回到 buddy，它已不在隔离列表里，不能再当作目标；
+ * 它原先占用的目标槽位由调用者重新规划后交给其他碎片。
+ * 返回丢弃的页数。
+ */
+static unsigned int dpu_compact_drop_movers(struct dpu_compact_region *region)
+{
+    struct dpu_fragment *frag, *tmp;
+    unsigned int nr = 0;
+    u64 start_ns = ktime_get_ns();
+
+    list_for_each_entry_safe(frag, tmp, &region->fragments, list) {
+        if (!dpu_fragment_needs_copy(frag) || frag->is_hot)
+            continue;
+
+        if (!dpu_compact_drop_clean(frag))
+            continue;
+
+        list_del(&frag->list);
+        kfree(frag);
+        region->nr_fragments--;
+        nr++;
+    }
+
+    region->nr_dropped += nr;
+    region->unmap_ns += ktime_get_ns() - start_ns;
+    return nr;
+}
+
 /* --- 6. 建立 migration entries (关键修复) --- */
 static int dpu_compact_unmap_pages(struct dpu_compact_region *region)
 {
     struct dpu_fragment *frag;
     int page_was_mapped;
     struct folio *src_folio;
+    u64 start_ns = ktime_get_ns();
 
+    /* 留在原地的碎片不需要 migration entry */
     list_for_each_entry(frag, &region->fragments, list) {
-        if (!frag->is_frag)
+        if (!dpu_fragment_needs_copy(frag))
             continue;
 
         src_folio = page_folio(frag->page);
@@ -239,97 +351,343 @@ static int dpu_compact_unmap_pages(struct dpu_compact_region *region)
         frag->was_mapped = page_was_mapped;
     }
 
+    region->unmap_ns += ktime_get_ns() - start_ns;
+    return 0;
+}
+
+/* --- 7. DPU 失败描述符的 CPU 回退 --- */
+static unsigned int dpu_compact_retry_failed(struct dpu_compact_region *region)
+{
+    struct dpu_fragment *frag;
+    unsigned int nr_failed = 0;
+
+    /* 目标都是隔离到的空闲页，描述符之间没有依赖，可以逐个重做 */
+    list_for_each_entry(frag, &region->fragments, list) {
+        if (!dpu_fragment_needs_copy(frag) || frag->copy_status == 0)
+            continue;
+
+        region->nr_cpu_retried++;
+
+        if (pfn_valid(frag->new_pfn)) {
+            copy_highpage(pfn_to_page(frag->new_pfn), frag->page);
+            frag->copy_status = 0;
+            continue;
+        }
+
+        pr_debug("DPU compact: rolling back PFN %lu -> %lu (%d)\n",
+                 frag->old_pfn, frag->new_pfn, frag->copy_status);
+        clear_bit(frag->new_pfn - region->base_pfn, region->dst_map);
+        nr_failed++;
+    }
+
+    return nr_failed;
+}
+
+/* 单个失败碎片回退：恢复指向原页的映射并放回 LRU */
+static void dpu_compact_rollback_fragment(struct dpu_fragment *frag)
+{
+    struct folio *folio = page_folio(frag->page);
+
+    if (frag->was_mapped)
+        remove_migration_ptes(folio, folio, false);
+
+    unlock_page(frag->page);
+    putback_lru_page(frag->page);
+
+    if (frag->anon_vma) {
+        put_anon_vma(frag->anon_vma);
+        frag->anon_vma = NULL;
+    }
+    frag->was_mapped = 0;
+}
+
+/*
+ * 提交阶段失败：源页仍持有完整数据（目标只取空闲页，不会被其他描述符
+ * 覆盖），按回退处理；目标页没有用上，交还 buddy。
+ */
+static void dpu_compact_abort_commit(struct dpu_compact_region *region,
+                                     struct dpu_fragment *frag)
+{
+    dpu_compact_rollback_fragment(frag);
+    clear_bit(frag->new_pfn - region->base_pfn, region->dst_map);
+    __free_page(pfn_to_page(frag->new_pfn));
+    region->nr_copy_failed++;
+}
+
+/* --- 8. 放置策略 --- */
+/*
+ * 排序键：冷页在前、热页在后，冷热分开聚集；同一 anon_vma / address_space
+ * 的页相邻，落到相邻的目标槽位；组内保持 PFN 顺序。
+ */
+static int dpu_compact_plan_cmp(const void *a, const void *b)
+{
+    const struct dpu_fragment *fa = *(const struct dpu_fragment **)a;
+    const struct dpu_fragment *fb = *(const struct dpu_fragment **)b;
+
+    if (fa->is_hot != fb->is_hot)
+        return fa->is_hot ? 1 : -1;
+    if (fa->owner != fb->owner)
+        return fa->owner < fb->owner ? -1 : 1;
+    if (fa->old_pfn != fb->old_pfn)
+        return fa->old_pfn < fb->old_pfn ? -1 : 1;
+    return 0;
+}
+
+/*
+ * 双指针选出要搬的碎片和目标槽位：低指针从区域起点找空闲页，高指针
+ * 从区域末尾找碎片，两者相遇为止。目标只取隔离到的 buddy 空闲页，且
+ * 只取 MIGRATE_MOVABLE pageblock 中的，可移动页不会被放进其他类型的块。
+ * 碎片搬走后留下的原页面在提交时直接释放，不会再被当作目标，所以
+ * 描述符之间没有依赖，单个描述符失败只影响它自己。
+ *
+ * 每个目标都低于每个被搬的碎片，选出的集合内可以任意配对：
+ * 按放置顺序排序后依次分配升序的目标槽位。
+ * 规划完成后链表按描述符顺序重排，目标槽位记录在 dst_map 中。
+ */
+static int dpu_compact_plan(struct dpu_compact_region *region)
+{
+    struct dpu_fragment **slots, **plan;
+    struct dpu_fragment *frag;
+    unsigned long *dst;
+    unsigned long low, high;
+    unsigned int nr = 0, i;
+
+    slots = kcalloc(region->region_size, sizeof(*slots), GFP_KERNEL);
+    plan = kmalloc_array(region->nr_fragments, sizeof(*plan), GFP_KERNEL);
+    dst = kmalloc_array(region->nr_fragments, sizeof(*dst), GFP_KERNEL);
+    if (!slots || !plan || !dst) {
+        kfree(slots);
+        kfree(plan);
+        kfree(dst);
+        return -ENOMEM;
+    }
+
+    list_for_each_entry(frag, &region->fragments, list) {
+        frag->new_pfn = frag->old_pfn;
+        slots[frag->old_pfn - region->base_pfn] = frag;
+    }
+
+    low = 0;
+    high = region->region_size;
+    while (low < high) {
+        frag = slots[low];
+        if (!frag || frag->is_frag || frag->migratetype != MIGRATE_MOVABLE) {
+            low++;
+            continue;
+        }
+
+        while (--high > low) {
+            if (slots[high] && slots[high]->is_frag)
+                break;
+        }
+        if (high <= low)
+            break;
+
+        plan[nr] = slots[high];
+        dst[nr] = low;
+        nr++;
+        low++;
+    }
+
+    sort(plan, nr, sizeof(*plan), dpu_compact_plan_cmp, NULL);
+
+    bitmap_zero(region->dst_map, region->region_size);
+    for (i = 0; i < nr; i++) {
+        set_bit(dst[i], region->dst_map);
+        plan[i]->new_pfn = region->base_pfn + dst[i];
+        list_move_tail(&plan[i]->list, &region->fragments);
+    }
+
+    kfree(slots);
+    kfree(plan);
+    kfree(dst);
     return 0;
 }
 
-/* --- 7. 计算迁移目标并触发 DPU --- */
+/* 规划后丢弃可丢的干净页；丢弃了就重新规划一次，空出的目标交给其他碎片 */
+static int dpu_compact_plan_drop(struct dpu_compact_region *region)
+{
+    int ret;
+
+    ret = dpu_compact_plan(region);
+    if (!ret && dpu_compact_drop_movers(region))
+        ret = dpu_compact_plan(region);
+    return ret;
+}
+
+/* --- 9. 计算迁移目标并触发 DPU --- */
 int dpu_compact_execute(struct dpu_compact_region *region)
 {
     int ret;
-    int last_pfn;
+    unsigned int nr_copies = 0;
+    u64 hw_start_ns;
     ktime_t start_time, end_time;
-    struct dpu_fragment *slow_frag, *fast_frag;
-    struct list_head *slow_pos, *fast_pos;
+    struct dpu_fragment *frag;
 
     if (region->state != DPU_COMPACT_COLLECTING || region->nr_fragments == 0)
         return -EINVAL;
 
     region->state = DPU_COMPACT_MOVING;
-    
-    /* 第一步：建立 migration entries */
-    ret = dpu_compact_unmap_pages(region);
-    if (ret)
-        return ret;
 
     start_time = ktime_get();
 
-    /* 第二步：计算 PFN 映射（双指针算法） */
-    slow_pos = region->fragments.next;
-    fast_pos = region->fragments.next;
-    slow_frag = list_entry(slow_pos, struct dpu_fragment, list);//空闲位置指针
+    /* 第一步：按放置策略计算 PFN 映射 */
+    ret = dpu_compact_plan_drop(region);
+    if (ret) {
+        region->state = DPU_COMPACT_FAILED;
+        return ret;
+    }
 
+    /* 第二步：只为要拷贝的碎片建立 migration entries */
+    ret = dpu_compact_unmap_pages(region);
+    if (ret)
+        return ret;
 
-    while (fast_pos != &region->fragments) {
-        fast_frag = list_entry(fast_pos, struct dpu_fragment, list);
-        if (fast_frag->is_frag) {
-            fast_frag->new_pfn = slow_frag->old_pfn;
-            slow_pos = slow_pos->next;
-            last_pfn = slow_frag->old_pfn;
+    /* 第三步：DPU 硬件搬运数据，未被 DPU 回写状态的描述符视为未完成 */
+    list_for_each_entry(frag, &region->fragments, list) {
+        if (dpu_fragment_needs_copy(frag)) {
+            frag->copy_status = -EINPROGRESS;
+            nr_copies++;
+        } else {
+            frag->copy_status = 0;
         }
-        fast_pos = fast_pos->next;
     }
-       
-
 
-    /* 第三步：DPU 硬件搬运数据 */
+    hw_start_ns = ktime_get_ns();
     ret = dpu_hw_compact_execute(region);
+    region->dpu_ns += ktime_get_ns() - hw_start_ns;
     
-    /* 必须添加内存屏障，确保 DPU 写入完成 */
-    if (!ret) {
+    /* 必须添加内存屏障，确保 DPU 写入完成；模拟器没有映射 DMA 缓冲区 */
+    if (ret > 0 && region->dpu_buffer_dma) {
         smp_wmb();
         dma_sync_single_for_cpu(NULL, region->dpu_buffer_dma, 
                                DPU_COMPACT_REGION_SIZE, DMA_FROM_DEVICE);
     }
+
+    /* 第四步：只重做失败的描述符，已完成的拷贝保留 */
+    region->nr_copy_failed = dpu_compact_retry_failed(region);
     
     end_time = ktime_get();
 
-    if (ret) {
+    /* 全部描述符都失败才整体回退，否则只回退失败的部分 */
+    if (nr_copies && region->nr_copy_failed == nr_copies) {
         region->state = DPU_COMPACT_FAILED;
-        return 0;
+        return -EIO;
     }
 
-    return last_pfn;
+    return 0;
 }
 
-/* --- 8. 更新映射与元数据 (完全重写) --- */
-int dpu_compact_update_mappings(struct dpu_compact_region *region,int last_pfn)
+/*
+ * 快速路径：未映射、无 private 的 page cache / swapcache 页批量替换
+ * xarray 条目。链表已按 address_space 分组，同一 mapping 的连续碎片
+ * 只持有一次 i_pages 锁。
+ *
+ * 新旧页在同一 zone、同一 memcg 下，folio_migrate_mapping() 中的
+ * lruvec/zone 统计增减相抵，这里直接省略。替换失败的碎片留给
+ * 常规路径处理。
+ */
+static void dpu_compact_remap_batched(struct dpu_compact_region *region)
+{
+    struct address_space *locked = NULL;
+    struct dpu_fragment *frag;
+    struct folio *src, *dst;
+    struct page *newpage;
+
+    list_for_each_entry(frag, &region->fragments, list) {
+        struct address_space *mapping;
+
+        if (!dpu_fragment_needs_copy(frag) || frag->copy_status || frag->was_mapped)
+            continue;
+
+        src = page_folio(frag->page);
+        mapping = folio_mapping(src);
+        if (!mapping || folio_test_private(src) || folio_mapped(src))
+            continue;
+
+        newpage = pfn_to_page(frag->new_pfn);
+        dst = page_folio(newpage);
+        if (!trylock_page(newpage))
+            continue;
+
+        if (mapping != locked) {
+            if (locked)
+                xa_unlock_irq(&locked->i_pages);
+            xa_lock_irq(&mapping->i_pages);
+            locked = mapping;
+        }
+
+        /* page cache 一次 + isolate_lru_page() 一次 */
+        if (!folio_ref_freeze(src, 2)) {
+            unlock_page(newpage);
+            continue;
+        }
+
+        dst->index = src->index;
+        dst->mapping = src->mapping;
+        folio_ref_inc(dst);
+        if (folio_test_swapbacked(src)) {
+            __folio_set_swapbacked(dst);
+            if (folio_test_swapcache(src)) {
+                folio_set_swapcache(dst);
+                dst->private = folio_get_private(src);
+            }
+        }
+
+        /* 脏标记随页面迁移，和 folio_migrate_mapping() 一样在锁内完成 */
+        if (folio_test_dirty(src)) {
+            folio_clear_dirty(src);
+            folio_set_dirty(dst);
+        }
+
+        __xa_store(&mapping->i_pages, folio_index(src), dst, 0);
+        folio_ref_unfreeze(src, 1);
+
+        frag->fast_remap = true;
+        region->nr_fast_remap++;
+    }
+
+    if (locked)
+        xa_unlock_irq(&locked->i_pages);
+}
+
+/* --- 10. 更新映射与元数据 (完全重写) --- */
+int dpu_compact_update_mappings(struct dpu_compact_region *region)
 {
     struct dpu_fragment *frag;
     int rc;
+    u64 start_ns;
 
     if (region->state != DPU_COMPACT_MOVING)
         return -EINVAL;
 
     region->state = DPU_COMPACT_UPDATING;
+    start_ns = ktime_get_ns();
+
+    dpu_compact_remap_batched(region);
 
     list_for_each_entry(frag, &region->fragments, list) {
         struct folio *src_folio = page_folio(frag->page);
+        struct address_space *mapping;
         struct folio *dst_folio;
         struct page *newpage;
         
-        /* 空闲页直接放回 buddy 系统 */
-        if (frag->old_pfn > last_pfn) {
-            __free_page(frag->page);
-            unlock_page(frag->page);
+        /* 没有被用作目标的空闲页直接放回 buddy 系统，隔离时没有加锁 */
+        if (!frag->is_frag) {
+            if (!test_bit(frag->old_pfn - region->base_pfn, region->dst_map))
+                __free_page(frag->page);
+            continue;
+        }
+
+        /* 拷贝失败的碎片单独回退，其余碎片照常提交 */
+        if (frag->copy_status) {
+            dpu_compact_rollback_fragment(frag);
             continue;
         }
 
-        /* 原地不动的页面 */
+        /* 原地不动的页面，可能已装上 migration entry，按回退处理 */
         if (frag->old_pfn == frag->new_pfn) {
-            unlock_page(frag->page);
-            putback_lru_page(frag->page);
-            if (frag->anon_vma)
-                put_anon_vma(frag->anon_vma);
+            dpu_compact_rollback_fragment(frag);
             continue;
         }
 
@@ -337,13 +695,14 @@ int dpu_compact_update_mappings(struct dpu_compact_region *region,int last_pfn)
         newpage = pfn_to_page(frag->new_pfn);
         dst_folio = page_folio(newpage);
 
+        /* 批量路径已锁定新页并完成 xarray 替换 */
+        if (frag->fast_remap)
+            goto migrate_flags;
+
         /* 锁定新页面 */
         if (!trylock_page(newpage)) {
             pr_err("DPU compact: failed to lock new page\n");
-            unlock_page(frag->page);
-            putback_lru_page(frag->page);
-            if (frag->anon_vma)
-                put_anon_vma(frag->anon_vma);
+            dpu_compact_abort_commit(region, frag);
             continue;
         }
 
@@ -354,16 +713,14 @@ int dpu_compact_update_mappings(struct dpu_compact_region *region,int last_pfn)
          * - 处理引用计数
          * - 更新统计信息
          */
-        if (src_folio->mapping) {
-            rc = folio_migrate_mapping(src_folio->mapping, dst_folio, 
+        mapping = folio_mapping(src_folio);
+        if (mapping) {
+            rc = folio_migrate_mapping(mapping, dst_folio, 
                                       src_folio, 0);
             if (rc != MIGRATEPAGE_SUCCESS) {
                 pr_err("DPU compact: mapping migration failed\n");
                 unlock_page(newpage);
-                unlock_page(frag->page);
-                putback_lru_page(frag->page);
-                if (frag->anon_vma)
-                    put_anon_vma(frag->anon_vma);
+                dpu_compact_abort_commit(region, frag);
                 continue;
             }
         } else {
@@ -374,12 +731,22 @@ int dpu_compact_update_mappings(struct dpu_compact_region *region,int last_pfn)
                 __folio_set_swapbacked(dst_folio);
         }
 
+migrate_flags:
         /*
          * 核心修复2: 复制页面标志和元数据
          * 这会正确复制所有软件状态
          */
         folio_migrate_flags(dst_folio, src_folio);
 
+        /*
+         * 和 move_to_new_folio() 一样：批量路径和 folio_migrate_mapping()
+         * 都只替换了 xarray 条目，page cache 源页仍指向 mapping，
+         * free_pages_prepare() 不会清它，释放时会报 bad_page。
+         * 匿名页的 mapping 带标志位，由释放路径清除。
+         */
+        if (!folio_mapping_flags(src_folio))
+            src_folio->mapping = NULL;
+
         /*
          * 核心修复3: 恢复所有映射
          * remove_migration_ptes() 会：
@@ -414,46 +781,41 @@ int dpu_compact_update_mappings(struct dpu_compact_region *region,int last_pfn)
          * - 现在释放这个引用
          */
         put_page(frag->page);
-        
+
         /*
-         * 新页面：
-         * - folio_migrate_mapping() 已经正确设置了引用计数
-         * - 不需要额外操作
+         * 新页面：folio_migrate_mapping() 或批量路径加上了 page cache
+         * 引用，remove_migration_ptes() 为每个映射加了引用；拆分 buddy
+         * 页得到的那次引用和 migrate_folio_move() 一样在这里放掉
          */
+        folio_put(dst_folio);
+
+        region->total_moved++;
+        if (frag->memcg_id != region->memcg_id)
+            dpu_memcg_charge(frag->memcg_id, DPU_MEMCG_VICTIM, 1);
     }
 
     /* 全局 TLB 刷新 */
     flush_tlb_all();
 
-    region->state = DPU_COMPACT_COMPLETE;
+    region->remap_ns += ktime_get_ns() - start_ns;
+
+    region->state = region->nr_copy_failed ? DPU_COMPACT_PARTIAL : DPU_COMPACT_COMPLETE;
     return 0;
 }
 
-/* --- 9. 清理函数 --- */
+/* --- 11. 清理函数 --- */
 static void dpu_compact_cleanup(struct dpu_compact_region *region, bool success)
 {
     struct dpu_fragment *frag, *tmp;
 
     if (!success) {
-        /* 失败情况：恢复所有页面 */
+        /* 失败情况：恢复所有页面，rollback 会移除 migration entry */
         list_for_each_entry_safe(frag, tmp, &region->fragments, list) {
-            struct folio *folio = page_folio(frag->page);
-            
-            /* 恢复映射（如果有 migration entries） */
-            if (frag->was_mapped && folio_mapped(folio))
-                remove_migration_ptes(folio, folio, false);
-            
-            if (frag->is_frag) {
-                unlock_page(frag->page);
-                putback_lru_page(frag->page);
-            } else {
-                unlock_page(frag->page);
+            if (frag->is_frag)
+                dpu_compact_rollback_fragment(frag);
+            else
                 __free_page(frag->page);
-            }
-            
-            if (frag->anon_vma)
-                put_anon_vma(frag->anon_vma);
-            
+
             list_del(&frag->list);
             kfree(frag);
         }
@@ -468,17 +830,38 @@ static void dpu_compact_cleanup(struct dpu_compact_region *region, bool success)
     region->nr_fragments = 0;
 }
 
-/* --- 10. 入口函数 --- */
+/* 把区域的开销记到请求者 memcg 名下 */
+static void dpu_compact_charge_region(struct dpu_compact_region *region, u64 stall_ns)
+{
+    u64 id = region->memcg_id;
+
+    dpu_memcg_charge(id, DPU_MEMCG_MOVED, region->total_moved);
+    dpu_memcg_charge(id, DPU_MEMCG_DPU_NS, region->dpu_ns);
+    dpu_memcg_charge(id, DPU_MEMCG_UNMAP_NS, region->unmap_ns);
+    dpu_memcg_charge(id, DPU_MEMCG_REMAP_NS, region->remap_ns);
+    dpu_memcg_charge(id, DPU_MEMCG_STALL_NS, stall_ns);
+}
+
+/* --- 12. 入口函数 --- */
 int dpu_compact_memory(struct zone *zone, unsigned int order)
 {
     struct dpu_compact_region *region;
     unsigned long start_pfn, region_pfn;
-    int last_pfn;
+    u64 memcg_id;
+    u64 start_ns;
     int ret = COMPACT_COMPLETE;
 
+    KUNIT_STATIC_STUB_REDIRECT(dpu_compact_memory, zone, order);
+
     if (!dpu_compact_available() || order < pageblock_order)
         return COMPACT_SKIPPED;
 
+    /* 请求者 memcg 本窗口的预算已用完 */
+    memcg_id = dpu_memcg_current_id();
+    if (!dpu_memcg_may_compact(memcg_id))
+        return COMPACT_SKIPPED;
+    start_ns = ktime_get_ns();
+
     start_pfn = zone->zone_start_pfn;
     region_pfn = ALIGN(start_pfn, DPU_COMPACT_REGION_SIZE >> PAGE_SHIFT);
 
@@ -490,6 +873,7 @@ int dpu_compact_memory(struct zone *zone, unsigned int order)
         return COMPACT_FAILED;
 
     region->state = DPU_COMPACT_COLLECTING;
+    region->memcg_id = memcg_id;
 
     /* 隔离页面 */
     dpu_compact_isolate_pages(zone, region, region_pfn, 
@@ -501,8 +885,7 @@ int dpu_compact_memory(struct zone *zone, unsigned int order)
     }
 
     /* 执行迁移 */
-    last_pfn = dpu_compact_execute(region);
-    if (last_pfn == 0) {
+    if (dpu_compact_execute(region)) {
         ret = COMPACT_FAILED;
         dpu_compact_cleanup(region, false);
         goto out_free;
@@ -510,21 +893,28 @@ int dpu_compact_memory(struct zone *zone, unsigned int order)
 
 
     /* 更新映射 */
-    if (dpu_compact_update_mappings(region, last_pfn) != 0) {
+    if (dpu_compact_update_mappings(region) != 0) {
         ret = COMPACT_FAILED;
         dpu_compact_cleanup(region, false);
         goto out_free;
     }
 
-    ret = COMPACT_SUCCESS;
+    /* 有描述符回退时目标块不一定凑齐，按部分完成报告 */
+    ret = region->state == DPU_COMPACT_PARTIAL ? COMPACT_PARTIAL_SKIPPED : COMPACT_SUCCESS;
+    if (region->nr_copy_failed)
+        pr_info("DPU compact: %u descriptors rolled back, %u retried on the CPU\n",
+                region->nr_copy_failed, region->nr_cpu_retried);
+    pr_debug("DPU compact: %u clean pages dropped, %u remapped in batches\n",
+             region->nr_dropped, region->nr_fast_remap);
     dpu_compact_cleanup(region, true);
 
 out_free:
-    if (region->dpu_buffer)
-        kfree(region->dpu_buffer);
-    if (region->dpu_addr_list)
-        kfree(region->dpu_addr_list);
-    kfree(region);
+    dpu_compact_charge_region(region, ktime_get_ns() - start_ns);
+    dpu_compact_region_destroy(region);
     
     return ret;
-}
\ No newline at end of file
+}
+
+#ifdef CONFIG_DPU_COMPACT_KUNIT_TEST
+#include "dpu_compact_test.c"
+#endif
\ No newline at end of file
@@ -6,6 +6,7 @@
 #include <linux/list.h>
 #include <linux/spinlock.h>
 #include <linux/rmap.h>
+#include <linux/compaction.h>
 #define DPU_COMPACT_REGION_SHIFT	21  /* 2MB regions */
 #define DPU_COMPACT_REGION_SIZE		(1UL << DPU_COMPACT_REGION_SHIFT)
 #define DPU_COMPACT_REGION_MASK		(~(DPU_COMPACT_REGION_SIZE - 1))//通过 & 掩码运算，低 21 位会被强制清零，结果就是该块的首地址
@@ -18,6 +19,7 @@ enum dpu_compact_state {
 	DPU_COMPACT_MOVING,	/* DPU is moving pages */
 	DPU_COMPACT_UPDATING,	/* Updating page tables */
 	DPU_COMPACT_COMPLETE,
+	DPU_COMPACT_PARTIAL,	/* Some descriptors rolled back */
 	DPU_COMPACT_FAILED,
 };
 struct dpu_fragment {
@@ -33,6 +35,16 @@ struct dpu_fragment {
 	bool is_anon;			/* Anonymous page */
 	bool is_dirty;			/* Dirty page */
 	bool is_frag;         /* Is fragment from buddy allocator */
+	struct anon_vma *anon_vma;	/* Pinned anon_vma (anon pages) */
+	int was_mapped;			/* Migration entries installed */
+	int copy_status;		/* Per-descriptor copy result, 0 = copied */
+
+	/* Placement policy inputs, sampled at isolation time */
+	int migratetype;		/* Pageblock migratetype of old_pfn */
+	bool is_hot;			/* Active or referenced on the LRU */
+	void *owner;			/* anon_vma or address_space */
+	u64 memcg_id;			/* Owning memcg cgroup id, 0 if none */
+	bool fast_remap;		/* Cache entry replaced in the batch pass */
 };
 /* DPU compaction region control structure */
 struct dpu_compact_region {
@@ -47,18 +59,33 @@ struct dpu_compact_region {
 	/* DPU communication */
 	uint64_t *dpu_addr_list;	/* Physical addresses for DPU */ //对应dpu内存，保存碎片的物理地址集合
 	void *dpu_buffer;		/* DMA buffer for DPU *///对应DPU上的内存，此处只做模拟
+	dma_addr_t dpu_buffer_dma;	/* Bus address of dpu_buffer */
 
 	/* State management */
 	enum dpu_compact_state state;
 	spinlock_t lock;
 
+	/* Partial rollback tracking, one bit per page in the region */
+	unsigned long *dst_map;		/* Free slots receiving a copied page */
+
 	/* Statistics */
 	unsigned long total_moved;
+	unsigned int nr_cpu_retried;	/* Descriptors redone on the CPU */
+	unsigned int nr_copy_failed;	/* Descriptors rolled back */
+	unsigned int nr_dropped;	/* Clean cache pages dropped, not copied */
+	unsigned int nr_fast_remap;	/* Unmapped pages remapped in batches */
 	unsigned long time_start;
 	unsigned long time_end;
+
+	/* Cost accounting, charged to the requesting memcg */
+	u64 memcg_id;			/* cgroup id of the requesting memcg */
+	u64 unmap_ns;			/* CPU time installing migration entries */
+	u64 dpu_ns;			/* Time spent in the DPU copy */
+	u64 remap_ns;			/* CPU time restoring mappings */
 };
 struct dpu_compact_region *dpu_compact_region_create(unsigned long base_pfn,
 						     unsigned long size);
+void dpu_compact_region_destroy(struct dpu_compact_region *region);
 int dpu_compact_execute(struct dpu_compact_region *region);
 int dpu_compact_memory(struct zone *zone, unsigned int order);
 int dpu_compact_isolate_pages(struct zone *zone,
@@ -67,7 +94,58 @@ int dpu_compact_isolate_pages(struct zone *zone,
 			      unsigned long end_pfn);
 int dpu_hw_compact_execute(struct dpu_compact_region *region);
 int dpu_compact_update_mappings(struct dpu_compact_region *region);
+enum compact_result try_dpu_compact_zone(struct zone *zone,
+					 unsigned int order,
+					 gfp_t gfp_mask);
+
+/* Per-memcg cost items */
+enum dpu_memcg_item {
+	DPU_MEMCG_MOVED,	/* Pages moved on behalf of this memcg */
+	DPU_MEMCG_VICTIM,	/* Own pages moved on behalf of another memcg */
+	DPU_MEMCG_DPU_NS,
+	DPU_MEMCG_UNMAP_NS,
+	DPU_MEMCG_REMAP_NS,
+	DPU_MEMCG_STALL_NS,
+	NR_DPU_MEMCG_ITEMS,
+};
+
+#ifdef CONFIG_MEMCG
+extern bool dpu_memcg_prefer_optin;
+
+u64 dpu_memcg_current_id(void);
+u64 dpu_page_memcg_id(struct page *page);
+void dpu_memcg_charge(u64 id, enum dpu_memcg_item item, u64 val);
+bool dpu_memcg_may_compact(u64 id);
+bool dpu_memcg_may_move(u64 requester, u64 owner);
+int dpu_memcg_set_budget(u64 id, unsigned long pages,
+			 u64 dpu_ns, bool opt_in);
+void dpu_memcg_remove(u64 id);
+#else
+static inline u64 dpu_memcg_current_id(void)
+{
+	return 0;
+}
+static inline u64 dpu_page_memcg_id(struct page *page)
+{
+	return 0;
+}
+static inline void dpu_memcg_charge(u64 id, enum dpu_memcg_item item,
+				    u64 val)
+{
+}
+static inline bool dpu_memcg_may_compact(u64 id)
+{
+	return true;
+}
+static inline bool dpu_memcg_may_move(u64 requester, u64 owner)
+{
+	return true;
+}
+#endif
+
 #ifdef CONFIG_DPU_COMPACTION
+extern int sysctl_dpu_compact_enabled;
+
 static inline bool dpu_compact_available(void)
 {
 	return sysctl_dpu_compact_enabled;
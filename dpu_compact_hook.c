@@ -2,6 +2,11 @@
 #include "dpu_compact.h"
 #include <linux/compaction.h>
 #include "internal.h"
+
+#ifdef CONFIG_DPU_COMPACTION
+int sysctl_dpu_compact_enabled __read_mostly = 1;
+#endif
+
 enum compact_result try_dpu_compact_zone(struct zone *zone,
 					 unsigned int order,
 					 gfp_t gfp_mask)
@@ -31,8 +36,8 @@ enum compact_result try_dpu_compact_zone(struct zone *zone,
 	case COMPACT_SUCCESS:
 		trace_printk("DPU: Compaction succeeded\n");
 		break;
-	case COMPACT_PARTIAL:
-		trace_printk("DPU: Compaction partially succeeded\n");
+	case COMPACT_PARTIAL_SKIPPED:
+		trace_printk("DPU: Compaction partially succeeded, some descriptors rolled back\n");
 		break;
 	case COMPACT_COMPLETE:
 		trace_printk("DPU: Compaction completed but no suitable block\n");
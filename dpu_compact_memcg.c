@@ -0,0 +1,411 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * DPU compaction cost accounting and budgets per memory cgroup.
+ *
+ * 所有开销记在触发整理的 memcg（请求者）名下，被移动页的 memcg 只记
+ * DPU_MEMCG_VICTIM。两者都按最近一个配置过预算的祖先（含自身）计，
+ * 子 cgroup 不能绕开租户的预算，也算作租户自己的页。预算按窗口限制请求者搬运的页数和 DPU 时间，
+ * 超出后 dpu_compact_memory() 直接跳过，不会再占用 DPU 带宽和 rmap 开销。
+ *
+ * 配置与统计在 debugfs 的 dpu_compact/memcg：
+ *   写入 "<cgroup inode> <pages> <dpu_us> <opt_in>" 设置预算，0 表示不限
+ *   读取列出每个 memcg 的累计开销
+ */
+#include <linux/mm.h>
+#include "dpu_compact.h"
+#include <linux/memcontrol.h>
+#include <linux/cgroup.h>
+#include <linux/kernfs.h>
+#include <linux/xarray.h>
+#include <linux/slab.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/uaccess.h>
+#include <linux/jiffies.h>
+#include <linux/rcupdate.h>
+
+struct dpu_memcg {
+	u64 id;			/* cgroup_id()，xarray 键在 32 位上会截断 */
+	struct rcu_head rcu;
+	atomic64_t stat[NR_DPU_MEMCG_ITEMS];
+
+	/* 预算，0 表示不限 */
+	unsigned long budget_pages;
+	u64 budget_dpu_ns;
+	bool opt_in;		/* 允许被其他 memcg 的整理移动 */
+	bool configured;	/* 通过 debugfs 设置过，子 cgroup 归到这里 */
+
+	/* 当前窗口内的消耗 */
+	spinlock_t lock;
+	unsigned long window_start;
+	unsigned long window_pages;
+	u64 window_dpu_ns;
+};
+
+/*
+ * 以 cgroup_id() 为键。它在系统运行期间单调递增、不会复用，
+ * 新建的 cgroup 不会继承已删除 cgroup 的预算、统计和 opt_in。
+ * mem_cgroup_id() 会被回收，不能用作键。
+ *
+ * 查找在 RCU 下进行，条目用 kfree_rcu() 释放。已删除 cgroup 的
+ * 条目在每创建 DPU_MEMCG_PRUNE_INTERVAL 个条目时清理一次。
+ */
+static DEFINE_XARRAY(dpu_memcgs);
+static unsigned int dpu_memcg_nr_created;
+#define DPU_MEMCG_PRUNE_INTERVAL	64
+
+/* 打开后只移动请求者自己和已 opt-in 的 memcg 的页 */
+bool dpu_memcg_prefer_optin __read_mostly;
+static u32 dpu_memcg_window_ms __read_mostly = 1000;
+
+/* 调用者持有 rcu_read_lock() */
+static struct dpu_memcg *dpu_memcg_lookup(u64 id)
+{
+	struct dpu_memcg *dm;
+
+	if (!id)
+		return NULL;
+
+	dm = xa_load(&dpu_memcgs, (unsigned long)id);
+	return dm && dm->id == id ? dm : NULL;
+}
+
+void dpu_memcg_remove(u64 id)
+{
+	struct dpu_memcg *dm;
+
+	xa_lock(&dpu_memcgs);
+	dm = xa_load(&dpu_memcgs, (unsigned long)id);
+	if (dm && dm->id == id)
+		__xa_erase(&dpu_memcgs, (unsigned long)id);
+	else
+		dm = NULL;
+	xa_unlock(&dpu_memcgs);
+
+	if (dm)
+		kfree_rcu(dm, rcu);
+}
+
+/*
+ * 在 memory 控制器所在的层级（v1 或 v2）里按 id 取 cgroup。
+ * cgroup_get_from_id() 只查 v2 层级，还会拒绝 current 的 cgroup
+ * namespace 之外的 cgroup，而整理可能由任意任务触发。
+ */
+static struct cgroup *dpu_memcg_cgroup_get(u64 id)
+{
+	struct cgroup *cgrp = NULL;
+	struct kernfs_node *kn;
+
+	kn = kernfs_find_and_get_node_by_id(memory_cgrp_subsys.root->kf_root, id);
+	if (!kn)
+		return NULL;
+
+	if (kernfs_type(kn) == KERNFS_DIR) {
+		rcu_read_lock();
+		cgrp = rcu_dereference(*(void __rcu __force **)&kn->priv);
+		if (cgrp && !cgroup_tryget(cgrp))
+			cgrp = NULL;
+		rcu_read_unlock();
+	}
+	kernfs_put(kn);
+
+	return cgrp;
+}
+
+/* 清理 cgroup 已被删除的条目，keep 是刚创建的条目 */
+static void dpu_memcg_prune(u64 keep)
+{
+	struct dpu_memcg *dm;
+	struct cgroup *cgrp;
+	unsigned long index;
+	u64 id;
+
+	/* 条目可能被并发删除，整个遍历都在 RCU 下 */
+	rcu_read_lock();
+	xa_for_each(&dpu_memcgs, index, dm) {
+		id = dm->id;
+		if (id == keep)
+			continue;
+
+		cgrp = dpu_memcg_cgroup_get(id);
+		if (!cgrp) {
+			dpu_memcg_remove(id);
+			continue;
+		}
+		cgroup_put(cgrp);
+	}
+	rcu_read_unlock();
+}
+
+/* 条目已存在或创建成功返回 0 */
+static int dpu_memcg_create(u64 id)
+{
+	struct dpu_memcg *dm, *old;
+
+	if (!id)
+		return -EINVAL;
+
+	if (xa_load(&dpu_memcgs, (unsigned long)id))
+		return 0;
+
+	dm = kzalloc(sizeof(*dm), GFP_KERNEL);
+	if (!dm)
+		return -ENOMEM;
+	dm->id = id;
+	spin_lock_init(&dm->lock);
+	dm->window_start = jiffies;
+
+	old = xa_cmpxchg(&dpu_memcgs, (unsigned long)id, NULL, dm, GFP_KERNEL);
+	if (old) {
+		kfree(dm);
+		return xa_is_err(old) ? xa_err(old) : 0;
+	}
+
+	if (!(++dpu_memcg_nr_created % DPU_MEMCG_PRUNE_INTERVAL))
+		dpu_memcg_prune(id);
+	return 0;
+}
+
+/* 调用者持有 dm->lock */
+static void dpu_memcg_roll_window(struct dpu_memcg *dm)
+{
+	if (time_before(jiffies, dm->window_start +
+			msecs_to_jiffies(dpu_memcg_window_ms)))
+		return;
+
+	dm->window_start = jiffies;
+	dm->window_pages = 0;
+	dm->window_dpu_ns = 0;
+}
+
+/*
+ * 取最近一个配置过的祖先（含自身）的 id，都没配置过就用自己的。
+ * 只看 configured，计费时为子 cgroup 自动创建的条目不算。
+ * 调用者持有 rcu_read_lock()。
+ */
+static u64 dpu_memcg_resolve(struct mem_cgroup *memcg)
+{
+	struct mem_cgroup *iter;
+	struct dpu_memcg *dm;
+
+	for (iter = memcg; iter; iter = parent_mem_cgroup(iter)) {
+		dm = dpu_memcg_lookup(cgroup_id(iter->css.cgroup));
+		if (dm && READ_ONCE(dm->configured))
+			return dm->id;
+	}
+	return cgroup_id(memcg->css.cgroup);
+}
+
+u64 dpu_memcg_current_id(void)
+{
+	struct mem_cgroup *memcg;
+	u64 id = 0;
+
+	if (mem_cgroup_disabled())
+		return 0;
+
+	memcg = get_mem_cgroup_from_mm(current->mm);
+	if (memcg) {
+		rcu_read_lock();
+		id = dpu_memcg_resolve(memcg);
+		rcu_read_unlock();
+		mem_cgroup_put(memcg);
+	}
+	return id;
+}
+
+u64 dpu_page_memcg_id(struct page *page)
+{
+	struct mem_cgroup *memcg;
+	u64 id = 0;
+
+	rcu_read_lock();
+	memcg = folio_memcg(page_folio(page));
+	if (memcg)
+		id = dpu_memcg_resolve(memcg);
+	rcu_read_unlock();
+
+	return id;
+}
+
+void dpu_memcg_charge(u64 id, enum dpu_memcg_item item, u64 val)
+{
+	struct dpu_memcg *dm;
+
+	if (!val || dpu_memcg_create(id))
+		return;
+
+	rcu_read_lock();
+	dm = dpu_memcg_lookup(id);
+	if (!dm)
+		goto out;
+
+	atomic64_add(val, &dm->stat[item]);
+
+	if (item != DPU_MEMCG_MOVED && item != DPU_MEMCG_DPU_NS)
+		goto out;
+
+	spin_lock(&dm->lock);
+	dpu_memcg_roll_window(dm);
+	if (item == DPU_MEMCG_MOVED)
+		dm->window_pages += val;
+	else
+		dm->window_dpu_ns += val;
+	spin_unlock(&dm->lock);
+out:
+	rcu_read_unlock();
+}
+
+bool dpu_memcg_may_compact(u64 id)
+{
+	struct dpu_memcg *dm;
+	bool ok = true;
+
+	rcu_read_lock();
+	dm = dpu_memcg_lookup(id);
+	if (dm) {
+		spin_lock(&dm->lock);
+		dpu_memcg_roll_window(dm);
+		ok = (!dm->budget_pages || dm->window_pages < dm->budget_pages) &&
+		     (!dm->budget_dpu_ns || dm->window_dpu_ns < dm->budget_dpu_ns);
+		spin_unlock(&dm->lock);
+	}
+	rcu_read_unlock();
+
+	return ok;
+}
+
+bool dpu_memcg_may_move(u64 requester, u64 owner)
+{
+	struct dpu_memcg *dm;
+	bool ok;
+
+	if (!READ_ONCE(dpu_memcg_prefer_optin))
+		return true;
+
+	if (!owner || owner == requester)
+		return true;
+
+	rcu_read_lock();
+	dm = dpu_memcg_lookup(owner);
+	ok = dm && READ_ONCE(dm->opt_in);
+	rcu_read_unlock();
+
+	return ok;
+}
+
+int dpu_memcg_set_budget(u64 id, unsigned long pages, u64 dpu_ns, bool opt_in)
+{
+	struct dpu_memcg *dm;
+	int ret;
+
+	ret = dpu_memcg_create(id);
+	if (ret)
+		return ret;
+
+	rcu_read_lock();
+	dm = dpu_memcg_lookup(id);
+	if (dm) {
+		spin_lock(&dm->lock);
+		dm->budget_pages = pages;
+		dm->budget_dpu_ns = dpu_ns;
+		WRITE_ONCE(dm->opt_in, opt_in);
+		WRITE_ONCE(dm->configured, true);
+		spin_unlock(&dm->lock);
+	}
+	rcu_read_unlock();
+
+	/* 32 位上被另一个 id 占用了同一个键 */
+	return dm ? 0 : -EBUSY;
+}
+
+/* --- debugfs --- */
+
+static int dpu_memcg_show(struct seq_file *m, void *v)
+{
+	struct dpu_memcg *dm;
+	unsigned long index;
+
+	seq_puts(m, "ino moved victim dpu_ns unmap_ns remap_ns stall_ns "
+		    "budget_pages budget_dpu_ns opt_in\n");
+
+	rcu_read_lock();
+	xa_for_each(&dpu_memcgs, index, dm) {
+		/* 64 位上 cgroup_id() 就是 cgroup 目录的 inode 号 */
+		seq_printf(m, "%llu %lld %lld %lld %lld %lld %lld %lu %llu %d\n", dm->id,
+			   atomic64_read(&dm->stat[DPU_MEMCG_MOVED]),
+			   atomic64_read(&dm->stat[DPU_MEMCG_VICTIM]),
+			   atomic64_read(&dm->stat[DPU_MEMCG_DPU_NS]),
+			   atomic64_read(&dm->stat[DPU_MEMCG_UNMAP_NS]),
+			   atomic64_read(&dm->stat[DPU_MEMCG_REMAP_NS]),
+			   atomic64_read(&dm->stat[DPU_MEMCG_STALL_NS]),
+			   dm->budget_pages, dm->budget_dpu_ns, dm->opt_in);
+	}
+	rcu_read_unlock();
+	return 0;
+}
+
+static int dpu_memcg_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, dpu_memcg_show, NULL);
+}
+
+static ssize_t dpu_memcg_write(struct file *file, const char __user *ubuf,
+			       size_t count, loff_t *ppos)
+{
+	struct cgroup_subsys_state *css;
+	struct cgroup *cgrp;
+	unsigned long pages;
+	u64 ino, dpu_us, id;
+	char buf[80];
+	int opt_in;
+	int ret;
+
+	if (count >= sizeof(buf))
+		return -EINVAL;
+	if (copy_from_user(buf, ubuf, count))
+		return -EFAULT;
+	buf[count] = '\0';
+
+	if (sscanf(buf, "%llu %lu %llu %d", &ino, &pages, &dpu_us, &opt_in) != 4)
+		return -EINVAL;
+
+	cgrp = dpu_memcg_cgroup_get(ino);
+	if (!cgrp)
+		return -ENOENT;
+
+	/* 未启用 memory 控制器的 cgroup 归到生效的祖先 memcg */
+	css = cgroup_get_e_css(cgrp, &memory_cgrp_subsys);
+	id = css ? cgroup_id(css->cgroup) : 0;
+	if (css)
+		css_put(css);
+	cgroup_put(cgrp);
+
+	ret = dpu_memcg_set_budget(id, pages, dpu_us * NSEC_PER_USEC, opt_in);
+	return ret ? ret : count;
+}
+
+static const struct file_operations dpu_memcg_fops = {
+	.open		= dpu_memcg_open,
+	.read		= seq_read,
+	.write		= dpu_memcg_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init dpu_memcg_debugfs_init(void)
+{
+	struct dentry *dir;
+
+	dir = debugfs_create_dir("dpu_compact", NULL);
+	debugfs_create_file("memcg", 0600, dir, NULL, &dpu_memcg_fops);
+	debugfs_create_bool("prefer_optin", 0600, dir, &dpu_memcg_prefer_optin);
+	debugfs_create_u32("budget_window_ms", 0600, dir, &dpu_memcg_window_ms);
+
+	return 0;
+}
+late_initcall(dpu_memcg_debugfs_init);
+
+#ifdef CONFIG_DPU_COMPACT_KUNIT_TEST
+#include "dpu_compact_memcg_test.c"
+#endif
@@ -0,0 +1,216 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * KUnit tests for DPU compaction memcg accounting.
+ *
+ * 本文件由 dpu_compact_memcg.c 末尾 #include，可以直接测试其中的
+ * static 函数，运行方式见 dpu_compact_test.c。
+ */
+#include <kunit/test.h>
+
+/* cgroup_id() 从 1 开始单调递增，永远到不了这些值 */
+#define DPU_TEST_MEMCG_ID	U64_MAX
+#define DPU_TEST_MEMCG_OWNER	(U64_MAX - 1)
+#define DPU_TEST_MEMCG_TENANT	(U64_MAX - 2)
+#define DPU_TEST_MEMCG_CHILD	(U64_MAX - 3)
+
+static bool dpu_test_saved_prefer_optin;
+
+static int dpu_compact_memcg_test_init(struct kunit *test)
+{
+	dpu_test_saved_prefer_optin = dpu_memcg_prefer_optin;
+	return 0;
+}
+
+/* 测试条目不能留在全局 xarray 里 */
+static void dpu_compact_memcg_test_exit(struct kunit *test)
+{
+	dpu_memcg_remove(DPU_TEST_MEMCG_ID);
+	dpu_memcg_remove(DPU_TEST_MEMCG_OWNER);
+	dpu_memcg_remove(DPU_TEST_MEMCG_TENANT);
+	dpu_memcg_remove(DPU_TEST_MEMCG_CHILD);
+	dpu_memcg_prefer_optin = dpu_test_saved_prefer_optin;
+}
+
+static bool dpu_test_memcg_exists(u64 id)
+{
+	bool found;
+
+	rcu_read_lock();
+	found = dpu_memcg_lookup(id);
+	rcu_read_unlock();
+
+	return found;
+}
+
+static void dpu_compact_test_memcg_budget(struct kunit *test)
+{
+	const u64 id = DPU_TEST_MEMCG_ID;
+
+	KUNIT_ASSERT_EQ(test, dpu_memcg_set_budget(id, 4, 0, false), 0);
+	KUNIT_EXPECT_TRUE(test, dpu_memcg_may_compact(id));
+
+	dpu_memcg_charge(id, DPU_MEMCG_MOVED, 3);
+	KUNIT_EXPECT_TRUE(test, dpu_memcg_may_compact(id));
+
+	/* 时间开销不计入页数预算 */
+	dpu_memcg_charge(id, DPU_MEMCG_UNMAP_NS, NSEC_PER_SEC);
+	KUNIT_EXPECT_TRUE(test, dpu_memcg_may_compact(id));
+
+	dpu_memcg_charge(id, DPU_MEMCG_MOVED, 1);
+	KUNIT_EXPECT_FALSE(test, dpu_memcg_may_compact(id));
+
+	/* 0 表示不限 */
+	KUNIT_ASSERT_EQ(test, dpu_memcg_set_budget(id, 0, 0, false), 0);
+	KUNIT_EXPECT_TRUE(test, dpu_memcg_may_compact(id));
+
+	KUNIT_ASSERT_EQ(test, dpu_memcg_set_budget(id, 0, NSEC_PER_MSEC, false), 0);
+	dpu_memcg_charge(id, DPU_MEMCG_DPU_NS, NSEC_PER_MSEC);
+	KUNIT_EXPECT_FALSE(test, dpu_memcg_may_compact(id));
+
+	KUNIT_EXPECT_EQ(test, dpu_memcg_set_budget(0, 1, 0, false), -EINVAL);
+
+	/* 删除后重新创建的条目不继承旧的预算和统计 */
+	KUNIT_EXPECT_FALSE(test, dpu_memcg_may_compact(id));
+	dpu_memcg_remove(id);
+	dpu_memcg_charge(id, DPU_MEMCG_DPU_NS, NSEC_PER_MSEC);
+	KUNIT_EXPECT_TRUE(test, dpu_memcg_may_compact(id));
+}
+
+static void dpu_compact_test_memcg_prefer_optin(struct kunit *test)
+{
+	const u64 requester = DPU_TEST_MEMCG_ID;
+	const u64 owner = DPU_TEST_MEMCG_OWNER;
+
+	dpu_memcg_prefer_optin = false;
+	KUNIT_EXPECT_TRUE(test, dpu_memcg_may_move(requester, owner));
+
+	dpu_memcg_prefer_optin = true;
+	KUNIT_ASSERT_EQ(test, dpu_memcg_set_budget(owner, 0, 0, false), 0);
+	KUNIT_EXPECT_FALSE(test, dpu_memcg_may_move(requester, owner));
+	KUNIT_EXPECT_TRUE(test, dpu_memcg_may_move(requester, requester));
+	KUNIT_EXPECT_TRUE(test, dpu_memcg_may_move(requester, 0));
+
+	KUNIT_ASSERT_EQ(test, dpu_memcg_set_budget(owner, 0, 0, true), 0);
+	KUNIT_EXPECT_TRUE(test, dpu_memcg_may_move(requester, owner));
+
+	dpu_memcg_remove(owner);
+	KUNIT_EXPECT_FALSE(test, dpu_memcg_may_move(requester, owner));
+}
+/*
+ * 存活的 cgroup 的条目不被清理，与当前任务的 cgroup namespace 无关。
+ * 根 memcg 在任何层级和 namespace 下都存活。
+ */
+static void dpu_compact_test_memcg_prune(struct kunit *test)
+{
+	struct cgroup *cgrp;
+	bool had_root;
+	u64 root;
+
+	if (mem_cgroup_disabled())
+		kunit_skip(test, "memcg disabled");
+
+	root = cgroup_id(root_mem_cgroup->css.cgroup);
+	cgrp = dpu_memcg_cgroup_get(root);
+	KUNIT_ASSERT_NOT_NULL(test, cgrp);
+	KUNIT_EXPECT_PTR_EQ(test, cgrp, root_mem_cgroup->css.cgroup);
+	cgroup_put(cgrp);
+	KUNIT_EXPECT_NULL(test, dpu_memcg_cgroup_get(DPU_TEST_MEMCG_ID));
+
+	had_root = dpu_test_memcg_exists(root);
+	KUNIT_ASSERT_EQ(test, dpu_memcg_create(root), 0);
+	KUNIT_ASSERT_EQ(test, dpu_memcg_create(DPU_TEST_MEMCG_ID), 0);
+
+	dpu_memcg_prune(0);
+	KUNIT_EXPECT_TRUE(test, dpu_test_memcg_exists(root));
+	KUNIT_EXPECT_FALSE(test, dpu_test_memcg_exists(DPU_TEST_MEMCG_ID));
+
+	if (!had_root)
+		dpu_memcg_remove(root);
+}
+
+/* 只有 dpu_memcg_resolve() 用到的字段：cgroup id 和父节点 */
+static struct mem_cgroup *dpu_test_memcg(struct kunit *test, u64 id,
+					 struct mem_cgroup *parent)
+{
+	struct mem_cgroup *memcg;
+	struct kernfs_node *kn;
+	struct cgroup *cgrp;
+
+	memcg = kunit_kzalloc(test, sizeof(*memcg), GFP_KERNEL);
+	cgrp = kunit_kzalloc(test, sizeof(*cgrp), GFP_KERNEL);
+	kn = kunit_kzalloc(test, sizeof(*kn), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, memcg);
+	KUNIT_ASSERT_NOT_NULL(test, cgrp);
+	KUNIT_ASSERT_NOT_NULL(test, kn);
+
+	kn->id = id;
+	cgrp->kn = kn;
+	memcg->css.cgroup = cgrp;
+	memcg->css.parent = parent ? &parent->css : NULL;
+
+	return memcg;
+}
+
+static u64 dpu_test_memcg_resolve(struct mem_cgroup *memcg)
+{
+	u64 id;
+
+	rcu_read_lock();
+	id = dpu_memcg_resolve(memcg);
+	rcu_read_unlock();
+
+	return id;
+}
+
+/* 子 cgroup 的搬运记到租户名下，受租户预算限制，也算租户自己的页 */
+static void dpu_compact_test_memcg_hierarchy(struct kunit *test)
+{
+	struct mem_cgroup *tenant, *child;
+	u64 id;
+
+	tenant = dpu_test_memcg(test, DPU_TEST_MEMCG_TENANT, NULL);
+	child = dpu_test_memcg(test, DPU_TEST_MEMCG_CHILD, tenant);
+
+	/* 没有配置过的祖先，记在自己名下；计费创建的条目不算配置 */
+	KUNIT_EXPECT_EQ(test, dpu_test_memcg_resolve(child), DPU_TEST_MEMCG_CHILD);
+	dpu_memcg_charge(DPU_TEST_MEMCG_TENANT, DPU_MEMCG_MOVED, 1);
+	KUNIT_EXPECT_EQ(test, dpu_test_memcg_resolve(child), DPU_TEST_MEMCG_CHILD);
+
+	KUNIT_ASSERT_EQ(test, dpu_memcg_set_budget(DPU_TEST_MEMCG_TENANT, 4, 0,
+						   false), 0);
+	id = dpu_test_memcg_resolve(child);
+	KUNIT_EXPECT_EQ(test, id, DPU_TEST_MEMCG_TENANT);
+	KUNIT_EXPECT_TRUE(test, dpu_memcg_may_compact(id));
+	dpu_memcg_charge(id, DPU_MEMCG_MOVED, 3);
+	KUNIT_EXPECT_FALSE(test, dpu_memcg_may_compact(dpu_test_memcg_resolve(child)));
+
+	dpu_memcg_prefer_optin = true;
+	KUNIT_EXPECT_TRUE(test, dpu_memcg_may_move(dpu_test_memcg_resolve(tenant),
+						   dpu_test_memcg_resolve(child)));
+
+	/* 子 cgroup 单独配置后按自己的预算计 */
+	KUNIT_ASSERT_EQ(test, dpu_memcg_set_budget(DPU_TEST_MEMCG_CHILD, 0, 0,
+						   false), 0);
+	id = dpu_test_memcg_resolve(child);
+	KUNIT_EXPECT_EQ(test, id, DPU_TEST_MEMCG_CHILD);
+	KUNIT_EXPECT_TRUE(test, dpu_memcg_may_compact(id));
+	KUNIT_EXPECT_FALSE(test, dpu_memcg_may_move(dpu_test_memcg_resolve(tenant),
+						    id));
+}
+
+static struct kunit_case dpu_compact_memcg_test_cases[] = {
+	KUNIT_CASE(dpu_compact_test_memcg_budget),
+	KUNIT_CASE(dpu_compact_test_memcg_prefer_optin),
+	KUNIT_CASE(dpu_compact_test_memcg_prune),
+	KUNIT_CASE(dpu_compact_test_memcg_hierarchy),
+	{}
+};
+
+static struct kunit_suite dpu_compact_memcg_test_suite = {
+	.name = "dpu_compact_memcg",
+	.init = dpu_compact_memcg_test_init,
+	.exit = dpu_compact_memcg_test_exit,
+	.test_cases = dpu_compact_memcg_test_cases,
+};
+
+kunit_test_suite(dpu_compact_memcg_test_suite);
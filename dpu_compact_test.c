@@ -0,0 +1,1207 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * KUnit tests for DPU compaction.
+ *
+ * 本文件由 dpu_compact.c 末尾 #include，可以直接测试其中的 static 函数。
+ * 本目录放在 mm/dpu/ 并接入 mm/Kconfig、mm/Makefile（见 README），然后
+ *   ./tools/testing/kunit/kunit.py run --kunitconfig=mm/dpu
+ */
+#include <kunit/test.h>
+#include <kunit/static_stub.h>
+#include <linux/fs.h>
+#include <linux/mount.h>
+#include <linux/ramfs.h>
+#include <linux/pagemap.h>
+#include "swap.h"
+
+#define DPU_TEST_BASE_PFN		0x100000UL
+#define DPU_TEST_REGION_PAGES		(DPU_COMPACT_REGION_SIZE >> PAGE_SHIFT)
+
+/*
+ * 性能回归门限。两个值都没有实测过，是按工作量估算后留出的余量，
+ * 拿到目标平台上的实测值后应按实测收紧：
+ * - 规划 1024 页的区域是一次线性扫描加对 256 个条目的排序，约两千次
+ *   比较和链表操作，按 UML 下每次 100ns 估算约 0.2ms，门限留 25 倍；
+ * - 隔离 2MB 区域中交替释放的 256 个页，每页取一次 zone 锁并拆分
+ *   buddy 块，按每页 10us 估算约 2.5ms，门限留 8 倍。
+ */
+#define DPU_TEST_BENCH_LOOPS		16
+#define DPU_TEST_PLAN_BUDGET_NS		(5 * NSEC_PER_MSEC)
+#define DPU_TEST_ISOLATE_BUDGET_NS	(20 * NSEC_PER_MSEC)
+
+static struct dpu_compact_region *dpu_test_region(struct kunit *test,
+						  unsigned long base_pfn,
+						  unsigned long size)
+{
+	struct dpu_compact_region *region;
+
+	region = dpu_compact_region_create(base_pfn, size);
+	KUNIT_ASSERT_NOT_NULL(test, region);
+	region->state = DPU_COMPACT_COLLECTING;
+
+	return region;
+}
+
+static void dpu_test_region_free(struct dpu_compact_region *region)
+{
+	/* 只释放 dpu_fragment 结构，页面由各测试自己处理 */
+	dpu_compact_cleanup(region, true);
+	dpu_compact_region_destroy(region);
+}
+
+/* 不带 struct page 的碎片，只给规划器使用 */
+static struct dpu_fragment *dpu_test_add(struct kunit *test,
+					 struct dpu_compact_region *region,
+					 unsigned long offset, bool is_frag,
+					 bool is_hot, void *owner,
+					 int migratetype)
+{
+	struct dpu_fragment *frag;
+
+	frag = kzalloc(sizeof(*frag), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, frag);
+
+	frag->old_pfn = region->base_pfn + offset;
+	frag->new_pfn = frag->old_pfn;
+	frag->is_frag = is_frag;
+	frag->is_hot = is_hot;
+	frag->owner = owner;
+	frag->migratetype = migratetype;
+
+	list_add_tail(&frag->list, &region->fragments);
+	region->nr_fragments++;
+
+	return frag;
+}
+
+/* 按 "F" / "." 描述布局：F 为碎片，. 为空闲页，全部可移动 */
+static void dpu_test_add_layout(struct kunit *test,
+				struct dpu_compact_region *region,
+				const char *layout)
+{
+	unsigned long i;
+
+	for (i = 0; layout[i]; i++)
+		dpu_test_add(test, region, i, layout[i] == 'F', false, NULL,
+			     MIGRATE_MOVABLE);
+}
+
+/*
+ * 按链表（描述符）顺序模拟 DPU 拷贝，检查规划结果：
+ * 只向低地址移动、目标是隔离到的空闲页（不复用碎片搬走后的源页）、
+ * 目标在 MIGRATE_MOVABLE 块中且记录在 dst_map。packed 为真时还要求
+ * 碎片全部紧凑在低端。
+ * 返回拷贝次数。
+ */
+static unsigned int dpu_test_check_plan(struct kunit *test,
+					struct dpu_compact_region *region,
+					bool packed)
+{
+	unsigned long size = region->region_size;
+	unsigned long *occupied, *slots, *free;
+	unsigned long src, dst, last;
+	struct dpu_fragment *frag;
+	unsigned int copies = 0;
+	int *slot_mt;
+
+	occupied = kunit_kcalloc(test, BITS_TO_LONGS(size), sizeof(long), GFP_KERNEL);
+	slots = kunit_kcalloc(test, BITS_TO_LONGS(size), sizeof(long), GFP_KERNEL);
+	free = kunit_kcalloc(test, BITS_TO_LONGS(size), sizeof(long), GFP_KERNEL);
+	slot_mt = kunit_kcalloc(test, size, sizeof(int), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, occupied);
+	KUNIT_ASSERT_NOT_NULL(test, slots);
+	KUNIT_ASSERT_NOT_NULL(test, free);
+	KUNIT_ASSERT_NOT_NULL(test, slot_mt);
+
+	list_for_each_entry(frag, &region->fragments, list) {
+		src = frag->old_pfn - region->base_pfn;
+		set_bit(src, slots);
+		slot_mt[src] = frag->migratetype;
+		if (frag->is_frag)
+			set_bit(src, occupied);
+		else
+			set_bit(src, free);
+	}
+
+	list_for_each_entry(frag, &region->fragments, list) {
+		if (!dpu_fragment_needs_copy(frag))
+			continue;
+
+		src = frag->old_pfn - region->base_pfn;
+		dst = frag->new_pfn - region->base_pfn;
+		KUNIT_EXPECT_LT(test, dst, src);
+		KUNIT_EXPECT_TRUE(test, test_and_clear_bit(dst, free));
+		KUNIT_EXPECT_FALSE(test, test_bit(dst, occupied));
+		KUNIT_EXPECT_EQ(test, slot_mt[dst], MIGRATE_MOVABLE);
+		KUNIT_EXPECT_TRUE(test, test_bit(dst, region->dst_map));
+
+		set_bit(dst, occupied);
+		clear_bit(src, occupied);
+		copies++;
+	}
+
+	KUNIT_EXPECT_EQ(test, bitmap_weight(region->dst_map, size), copies);
+
+	if (packed) {
+		last = find_last_bit(occupied, size);
+		for (src = 0; last < size && src < last; src++) {
+			if (test_bit(src, slots))
+				KUNIT_EXPECT_TRUE(test, test_bit(src, occupied));
+		}
+	}
+
+	return copies;
+}
+
+/* --- 规划器 --- */
+
+static void dpu_compact_test_plan_alternating(struct kunit *test)
+{
+	struct dpu_compact_region *region;
+
+	region = dpu_test_region(test, DPU_TEST_BASE_PFN, DPU_TEST_REGION_PAGES);
+	dpu_test_add_layout(test, region, ".F.F.F.F.F.F.F.F");
+
+	/* 只搬后一半碎片，填入前一半的空闲页 */
+	KUNIT_ASSERT_EQ(test, dpu_compact_plan(region), 0);
+	KUNIT_EXPECT_EQ(test, dpu_test_check_plan(test, region, true), 4);
+
+	dpu_test_region_free(region);
+}
+
+static void dpu_compact_test_plan_already_packed(struct kunit *test)
+{
+	struct dpu_compact_region *region;
+
+	region = dpu_test_region(test, DPU_TEST_BASE_PFN, DPU_TEST_REGION_PAGES);
+	dpu_test_add_layout(test, region, "FFFFFFFF........");
+
+	KUNIT_ASSERT_EQ(test, dpu_compact_plan(region), 0);
+	KUNIT_EXPECT_EQ(test, dpu_test_check_plan(test, region, true), 0);
+
+	dpu_test_region_free(region);
+}
+
+static void dpu_compact_test_plan_reversed(struct kunit *test)
+{
+	struct dpu_compact_region *region;
+
+	region = dpu_test_region(test, DPU_TEST_BASE_PFN, DPU_TEST_REGION_PAGES);
+	dpu_test_add_layout(test, region, "........FFFFFFFF");
+
+	KUNIT_ASSERT_EQ(test, dpu_compact_plan(region), 0);
+	KUNIT_EXPECT_EQ(test, dpu_test_check_plan(test, region, true), 8);
+
+	dpu_test_region_free(region);
+}
+
+static void dpu_compact_test_plan_skips_unmovable(struct kunit *test)
+{
+	struct dpu_compact_region *region;
+	struct dpu_fragment *frag;
+
+	region = dpu_test_region(test, DPU_TEST_BASE_PFN, DPU_TEST_REGION_PAGES);
+	dpu_test_add(test, region, 0, false, false, NULL, MIGRATE_UNMOVABLE);
+	dpu_test_add(test, region, 1, false, false, NULL, MIGRATE_MOVABLE);
+	frag = dpu_test_add(test, region, 2, true, false, NULL, MIGRATE_MOVABLE);
+
+	KUNIT_ASSERT_EQ(test, dpu_compact_plan(region), 0);
+	KUNIT_EXPECT_EQ(test, frag->new_pfn, region->base_pfn + 1);
+	KUNIT_EXPECT_EQ(test, dpu_test_check_plan(test, region, false), 1);
+
+	dpu_test_region_free(region);
+}
+
+static void dpu_compact_test_plan_cold_before_hot(struct kunit *test)
+{
+	struct dpu_compact_region *region;
+	struct dpu_fragment *hot, *cold;
+
+	region = dpu_test_region(test, DPU_TEST_BASE_PFN, DPU_TEST_REGION_PAGES);
+	dpu_test_add(test, region, 0, false, false, NULL, MIGRATE_MOVABLE);
+	dpu_test_add(test, region, 1, false, false, NULL, MIGRATE_MOVABLE);
+	hot = dpu_test_add(test, region, 2, true, true, NULL, MIGRATE_MOVABLE);
+	cold = dpu_test_add(test, region, 3, true, false, NULL, MIGRATE_MOVABLE);
+
+	KUNIT_ASSERT_EQ(test, dpu_compact_plan(region), 0);
+	KUNIT_EXPECT_LT(test, cold->new_pfn, hot->new_pfn);
+	KUNIT_EXPECT_EQ(test, dpu_test_check_plan(test, region, true), 2);
+
+	dpu_test_region_free(region);
+}
+
+static void dpu_compact_test_plan_groups_owner(struct kunit *test)
+{
+	static char owner_a, owner_b;
+	struct dpu_compact_region *region;
+	struct dpu_fragment *a0, *a1, *b0, *b1;
+	unsigned long i;
+
+	region = dpu_test_region(test, DPU_TEST_BASE_PFN, DPU_TEST_REGION_PAGES);
+	for (i = 0; i < 4; i++)
+		dpu_test_add(test, region, i, false, false, NULL, MIGRATE_MOVABLE);
+	a0 = dpu_test_add(test, region, 4, true, false, &owner_a, MIGRATE_MOVABLE);
+	b0 = dpu_test_add(test, region, 5, true, false, &owner_b, MIGRATE_MOVABLE);
+	a1 = dpu_test_add(test, region, 6, true, false, &owner_a, MIGRATE_MOVABLE);
+	b1 = dpu_test_add(test, region, 7, true, false, &owner_b, MIGRATE_MOVABLE);
+
+	KUNIT_ASSERT_EQ(test, dpu_compact_plan(region), 0);
+	KUNIT_EXPECT_EQ(test, a1->new_pfn, a0->new_pfn + 1);
+	KUNIT_EXPECT_EQ(test, b1->new_pfn, b0->new_pfn + 1);
+	KUNIT_EXPECT_EQ(test, dpu_test_check_plan(test, region, true), 4);
+
+	dpu_test_region_free(region);
+}
+
+/* --- 失败描述符的 CPU 重试与回退 --- */
+
+struct dpu_test_pages {
+	struct page *page;
+	unsigned long pfn;
+	struct dpu_compact_region *region;
+	struct dpu_fragment *a, *b;
+};
+
+/*
+ * 4 个连续页：A 从第 2 页搬到第 0 页（DPU 报错），B 从第 3 页搬到
+ * 第 1 页（DPU 未回写状态）。
+ */
+static void dpu_test_pages_init(struct kunit *test, struct dpu_test_pages *tp)
+{
+	tp->page = alloc_pages(GFP_KERNEL, 2);
+	KUNIT_ASSERT_NOT_NULL(test, tp->page);
+	split_page(tp->page, 2);
+
+	tp->pfn = page_to_pfn(tp->page);
+	tp->region = dpu_test_region(test,
+				     ALIGN_DOWN(tp->pfn, DPU_TEST_REGION_PAGES),
+				     DPU_TEST_REGION_PAGES);
+
+	memset(page_address(tp->page), 0x00, PAGE_SIZE);
+	memset(page_address(tp->page + 1), 0x00, PAGE_SIZE);
+	memset(page_address(tp->page + 2), 0xaa, PAGE_SIZE);
+	memset(page_address(tp->page + 3), 0xbb, PAGE_SIZE);
+
+	tp->a = dpu_test_add(test, tp->region, tp->pfn + 2 - tp->region->base_pfn,
+			     true, false, NULL, MIGRATE_MOVABLE);
+	tp->a->page = tp->page + 2;
+	tp->a->new_pfn = tp->pfn;
+	tp->a->copy_status = -EFAULT;
+	set_bit(tp->pfn - tp->region->base_pfn, tp->region->dst_map);
+
+	tp->b = dpu_test_add(test, tp->region, tp->pfn + 3 - tp->region->base_pfn,
+			     true, false, NULL, MIGRATE_MOVABLE);
+	tp->b->page = tp->page + 3;
+	tp->b->new_pfn = tp->pfn + 1;
+	tp->b->copy_status = -EINPROGRESS;
+	set_bit(tp->pfn + 1 - tp->region->base_pfn, tp->region->dst_map);
+}
+
+static void dpu_test_pages_free(struct dpu_test_pages *tp)
+{
+	int i;
+
+	dpu_test_region_free(tp->region);
+	for (i = 0; i < 4; i++)
+		__free_page(tp->page + i);
+}
+
+static void dpu_compact_test_retry_on_cpu(struct kunit *test)
+{
+	struct dpu_test_pages tp;
+
+	dpu_test_pages_init(test, &tp);
+
+	KUNIT_EXPECT_EQ(test, dpu_compact_retry_failed(tp.region), 0);
+	KUNIT_EXPECT_EQ(test, tp.region->nr_cpu_retried, 2);
+	KUNIT_EXPECT_EQ(test, tp.a->copy_status, 0);
+	KUNIT_EXPECT_EQ(test, tp.b->copy_status, 0);
+	KUNIT_EXPECT_EQ(test, *(u8 *)page_address(tp.page), 0xaa);
+	KUNIT_EXPECT_EQ(test, *(u8 *)page_address(tp.page + 1), 0xbb);
+	KUNIT_EXPECT_EQ(test, bitmap_weight(tp.region->dst_map,
+					    tp.region->region_size), 2);
+
+	dpu_test_pages_free(&tp);
+}
+
+/* --- 规划、拷贝到提交的完整流程 --- */
+
+#define DPU_TEST_COMMIT_ORDER	3
+#define DPU_TEST_COMMIT_PAGES	(1U << DPU_TEST_COMMIT_ORDER)
+
+struct dpu_test_commit {
+	struct page *page;
+	unsigned long pfn;
+	struct dpu_compact_region *region;
+	unsigned long *was_free;
+};
+
+/*
+ * ".F.F.F.F" 布局的真实页面：偶数页是隔离到的空闲页，奇数页是碎片，
+ * 带一次模拟 isolate_lru_page() 的引用并已加锁。执行完拷贝后检查
+ * 目标都是原来的空闲页且数据已到位。
+ */
+static void dpu_test_commit_init(struct kunit *test, struct dpu_test_commit *tc)
+{
+	struct dpu_compact_region *region;
+	struct dpu_fragment *frag;
+	unsigned int i;
+
+	tc->page = alloc_pages(GFP_KERNEL, DPU_TEST_COMMIT_ORDER);
+	KUNIT_ASSERT_NOT_NULL(test, tc->page);
+	split_page(tc->page, DPU_TEST_COMMIT_ORDER);
+	tc->pfn = page_to_pfn(tc->page);
+
+	region = dpu_test_region(test, ALIGN_DOWN(tc->pfn, DPU_TEST_REGION_PAGES),
+				 DPU_TEST_REGION_PAGES);
+	tc->region = region;
+	tc->was_free = kunit_kcalloc(test, BITS_TO_LONGS(region->region_size),
+				     sizeof(long), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, tc->was_free);
+
+	for (i = 0; i < DPU_TEST_COMMIT_PAGES; i++) {
+		frag = dpu_test_add(test, region, tc->pfn + i - region->base_pfn,
+				    i & 1, false, NULL, MIGRATE_MOVABLE);
+		frag->page = tc->page + i;
+		if (!frag->is_frag) {
+			set_bit(frag->old_pfn - region->base_pfn, tc->was_free);
+			continue;
+		}
+		memset(page_address(tc->page + i), 0x10 + i, PAGE_SIZE);
+		get_page(tc->page + i);
+		KUNIT_ASSERT_TRUE(test, trylock_page(tc->page + i));
+	}
+
+	KUNIT_ASSERT_EQ(test, dpu_compact_execute(region), 0);
+	KUNIT_EXPECT_EQ(test, region->nr_copy_failed, 0);
+
+	list_for_each_entry(frag, &region->fragments, list) {
+		if (!dpu_fragment_needs_copy(frag))
+			continue;
+		KUNIT_EXPECT_TRUE(test, test_bit(frag->new_pfn - region->base_pfn,
+						 tc->was_free));
+		KUNIT_EXPECT_EQ(test, *(u8 *)page_address(pfn_to_page(frag->new_pfn)),
+				0x10 + frag->old_pfn - tc->pfn);
+
+		/* 这些碎片没有映射也不在 page cache，提交后只剩测试这次引用 */
+		get_page(pfn_to_page(frag->new_pfn));
+	}
+}
+
+/*
+ * 提交后未用作目标的空闲页已放回 buddy，剩下的页都只持有测试自己的
+ * 引用且已解锁。原地不动或回退的碎片回到了 LRU，用 put_page() 释放。
+ * 返回提交成功的目标页数量。
+ */
+static unsigned int dpu_test_commit_free(struct kunit *test,
+					 struct dpu_test_commit *tc)
+{
+	struct dpu_compact_region *region = tc->region;
+	struct dpu_fragment *frag;
+	unsigned int moved = 0;
+	struct page *dst;
+
+	lru_add_drain();
+	list_for_each_entry(frag, &region->fragments, list) {
+		if (!frag->is_frag)
+			continue;
+		KUNIT_EXPECT_FALSE(test, PageLocked(frag->page));
+		KUNIT_EXPECT_EQ(test, page_ref_count(frag->page), 1);
+		put_page(frag->page);
+
+		if (!dpu_fragment_needs_copy(frag))
+			continue;
+		dst = pfn_to_page(frag->new_pfn);
+		KUNIT_EXPECT_FALSE(test, PageLocked(dst));
+		KUNIT_EXPECT_EQ(test, page_ref_count(dst), 1);
+		put_page(dst);
+		if (test_bit(frag->new_pfn - region->base_pfn, region->dst_map))
+			moved++;
+	}
+
+	dpu_test_region_free(region);
+	return moved;
+}
+
+/*
+ * 若规划器把碎片搬走后的源页当作后续碎片的目标，提交时源页已被
+ * 释放，这里会踩到已释放的页。
+ */
+static void dpu_compact_test_execute_commit(struct kunit *test)
+{
+	struct dpu_test_commit tc;
+
+	dpu_test_commit_init(test, &tc);
+
+	KUNIT_ASSERT_EQ(test, dpu_compact_update_mappings(tc.region), 0);
+	KUNIT_EXPECT_EQ(test, tc.region->state, DPU_COMPACT_COMPLETE);
+	KUNIT_EXPECT_EQ(test, tc.region->total_moved, DPU_TEST_COMMIT_PAGES / 4);
+
+	KUNIT_EXPECT_EQ(test, dpu_test_commit_free(test, &tc),
+			DPU_TEST_COMMIT_PAGES / 4);
+}
+
+/* 新页加锁失败：只回退这一个碎片，源页数据不变，目标页交还 */
+static void dpu_compact_test_commit_rollback(struct kunit *test)
+{
+	struct dpu_fragment *frag, *victim = NULL;
+	struct dpu_test_commit tc;
+	struct page *dst;
+
+	dpu_test_commit_init(test, &tc);
+
+	list_for_each_entry(frag, &tc.region->fragments, list) {
+		if (dpu_fragment_needs_copy(frag)) {
+			victim = frag;
+			break;
+		}
+	}
+	KUNIT_ASSERT_NOT_NULL(test, victim);
+
+	/* 模拟并发持有目标页锁的 PFN 扫描者，引用已在 init 中取得 */
+	dst = pfn_to_page(victim->new_pfn);
+	KUNIT_ASSERT_TRUE(test, trylock_page(dst));
+
+	KUNIT_ASSERT_EQ(test, dpu_compact_update_mappings(tc.region), 0);
+	KUNIT_EXPECT_EQ(test, tc.region->state, DPU_COMPACT_PARTIAL);
+	KUNIT_EXPECT_EQ(test, tc.region->nr_copy_failed, 1);
+	KUNIT_EXPECT_EQ(test, tc.region->total_moved, DPU_TEST_COMMIT_PAGES / 4 - 1);
+	KUNIT_EXPECT_FALSE(test, test_bit(victim->new_pfn - tc.region->base_pfn,
+					  tc.region->dst_map));
+	KUNIT_EXPECT_EQ(test, *(u8 *)page_address(victim->page),
+			0x10 + victim->old_pfn - tc.pfn);
+
+	/* 区域已放掉自己的引用，只剩模拟扫描者的 */
+	KUNIT_EXPECT_EQ(test, page_ref_count(dst), 1);
+	unlock_page(dst);
+
+	KUNIT_EXPECT_EQ(test, dpu_test_commit_free(test, &tc),
+			DPU_TEST_COMMIT_PAGES / 4 - 1);
+}
+
+/* --- 干净页丢弃与批量 xarray 替换 --- */
+
+struct dpu_test_file {
+	struct vfsmount *mnt;
+	struct inode *inode;
+	struct address_space *mapping;
+};
+
+/* 挂一个内部 ramfs，取一个不在任何目录下的普通文件做 page cache */
+static void dpu_test_file_init(struct kunit *test, struct dpu_test_file *tf)
+{
+	struct file_system_type *type;
+
+	type = get_fs_type("ramfs");
+	KUNIT_ASSERT_NOT_NULL(test, type);
+	tf->mnt = kern_mount(type);
+	module_put(type->owner);
+	KUNIT_ASSERT_FALSE(test, IS_ERR(tf->mnt));
+
+	tf->inode = ramfs_get_inode(tf->mnt->mnt_sb, NULL, S_IFREG | 0600, 0);
+	KUNIT_ASSERT_NOT_NULL(test, tf->inode);
+	tf->mapping = tf->inode->i_mapping;
+
+	/* ramfs 的页不可回收，改成普通文件页才能丢弃和迁移 */
+	mapping_clear_unevictable(tf->mapping);
+}
+
+/* iput() 截断剩余的 page cache */
+static void dpu_test_file_free(struct dpu_test_file *tf)
+{
+	iput(tf->inode);
+	kern_unmount(tf->mnt);
+}
+
+/*
+ * 把 page 加入 page cache 的 index 处，再和 dpu_compact_isolate_pages()
+ * 一样从 LRU 隔离并保持加锁：page cache 一次引用，隔离一次引用。
+ */
+static struct folio *dpu_test_file_add(struct kunit *test,
+				       struct dpu_test_file *tf,
+				       struct page *page, pgoff_t index, u8 fill)
+{
+	struct folio *folio = page_folio(page);
+
+	memset(page_address(page), fill, PAGE_SIZE);
+	__folio_set_locked(folio);
+	KUNIT_ASSERT_EQ(test, filemap_add_folio(tf->mapping, folio, index,
+						GFP_KERNEL), 0);
+	folio_mark_uptodate(folio);
+
+	lru_add_drain_all();
+	KUNIT_ASSERT_EQ(test, isolate_lru_page(page), 0);
+	folio_put(folio);
+	KUNIT_ASSERT_EQ(test, folio_ref_count(folio), 2);
+
+	return folio;
+}
+
+/* 放回 LRU 并解锁，留给 dpu_test_file_free() 截断 */
+static void dpu_test_file_putback(struct folio *folio)
+{
+	folio_unlock(folio);
+	putback_lru_page(&folio->page);
+}
+
+/* 干净、未映射的文件页：移出 page cache 后直接回到 buddy */
+static void dpu_compact_test_drop_clean(struct kunit *test)
+{
+	struct dpu_fragment frag = { .is_frag = true };
+	struct address_space *mapping;
+	struct dpu_test_file tf;
+	bool dropped, active, locked;
+	struct folio *folio;
+	struct page *page;
+	int ref;
+
+	dpu_test_file_init(test, &tf);
+	page = alloc_page(GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, page);
+	folio = dpu_test_file_add(test, &tf, page, 0, 0x11);
+	folio_set_active(folio);
+	frag.page = page;
+
+	/* 页面释放后不能被别人重新分配，读完状态再放开抢占 */
+	preempt_disable();
+	dropped = dpu_compact_drop_clean(&frag);
+	ref = page_ref_count(page);
+	active = PageActive(page);
+	locked = PageLocked(page);
+	mapping = page->mapping;
+	preempt_enable();
+
+	KUNIT_EXPECT_TRUE(test, dropped);
+	KUNIT_EXPECT_EQ(test, ref, 0);
+	KUNIT_EXPECT_FALSE(test, active);
+	KUNIT_EXPECT_FALSE(test, locked);
+	KUNIT_EXPECT_NULL(test, mapping);
+	KUNIT_EXPECT_EQ(test, tf.mapping->nrpages, 0);
+
+	dpu_test_file_free(&tf);
+}
+
+/* 原地不动的、脏的、热的文件页都不丢 */
+static void dpu_compact_test_drop_skips(struct kunit *test)
+{
+	struct dpu_compact_region *region;
+	struct dpu_fragment *frag;
+	struct folio *folios[3];
+	struct dpu_test_file tf;
+	unsigned int i;
+
+	dpu_test_file_init(test, &tf);
+	region = dpu_test_region(test, DPU_TEST_BASE_PFN, DPU_TEST_REGION_PAGES);
+	dpu_test_add_layout(test, region, "..");
+
+	for (i = 0; i < ARRAY_SIZE(folios); i++) {
+		struct page *page = alloc_page(GFP_KERNEL);
+
+		KUNIT_ASSERT_NOT_NULL(test, page);
+		folios[i] = dpu_test_file_add(test, &tf, page, i, 0x20 + i);
+		frag = dpu_test_add(test, region, 2 + i, true, i == 2, NULL,
+				    MIGRATE_MOVABLE);
+		frag->page = page;
+	}
+	folio_mark_dirty(folios[1]);
+
+	/* 第 2 页留在原地，第 3 页（脏）和第 4 页（热）搬到 0、1 */
+	KUNIT_ASSERT_EQ(test, dpu_compact_plan(region), 0);
+	KUNIT_EXPECT_EQ(test, dpu_test_check_plan(test, region, true), 2);
+
+	KUNIT_EXPECT_EQ(test, dpu_compact_drop_movers(region), 0);
+	KUNIT_EXPECT_EQ(test, region->nr_dropped, 0);
+	KUNIT_EXPECT_EQ(test, region->nr_fragments, 5);
+	KUNIT_EXPECT_EQ(test, tf.mapping->nrpages, 3);
+
+	for (i = 0; i < ARRAY_SIZE(folios); i++)
+		dpu_test_file_putback(folios[i]);
+	dpu_test_region_free(region);
+	dpu_test_file_free(&tf);
+}
+
+/* 丢掉一个要搬的干净页后重新规划，空出的目标 0 交给原本留在原地的碎片 */
+static void dpu_compact_test_drop_replan(struct kunit *test)
+{
+	struct dpu_fragment *frag, *stay = NULL, *mover = NULL;
+	struct dpu_compact_region *region;
+	struct page *pages[2], *page;
+	struct dpu_test_file tf;
+	unsigned int i;
+
+	dpu_test_file_init(test, &tf);
+	region = dpu_test_region(test, DPU_TEST_BASE_PFN, DPU_TEST_REGION_PAGES);
+	dpu_test_add_layout(test, region, "..");
+
+	/* 第 2、3 页不在 page cache，不能丢 */
+	for (i = 0; i < ARRAY_SIZE(pages); i++) {
+		pages[i] = alloc_page(GFP_KERNEL);
+		KUNIT_ASSERT_NOT_NULL(test, pages[i]);
+		frag = dpu_test_add(test, region, 2 + i, true, false, NULL,
+				    MIGRATE_MOVABLE);
+		frag->page = pages[i];
+		if (i == 0)
+			stay = frag;
+		else
+			mover = frag;
+	}
+
+	page = alloc_page(GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, page);
+	dpu_test_file_add(test, &tf, page, 0, 0x30);
+	frag = dpu_test_add(test, region, 4, true, false, NULL, MIGRATE_MOVABLE);
+	frag->page = page;
+
+	KUNIT_ASSERT_EQ(test, dpu_compact_plan(region), 0);
+	KUNIT_ASSERT_FALSE(test, dpu_fragment_needs_copy(stay));
+
+	KUNIT_ASSERT_EQ(test, dpu_compact_plan_drop(region), 0);
+	KUNIT_EXPECT_EQ(test, region->nr_dropped, 1);
+	KUNIT_EXPECT_EQ(test, region->nr_fragments, 4);
+	KUNIT_EXPECT_EQ(test, tf.mapping->nrpages, 0);
+	KUNIT_EXPECT_EQ(test, dpu_test_check_plan(test, region, true), 2);
+	KUNIT_EXPECT_TRUE(test, dpu_fragment_needs_copy(stay));
+	KUNIT_EXPECT_TRUE(test, dpu_fragment_needs_copy(mover));
+
+	dpu_test_region_free(region);
+	for (i = 0; i < ARRAY_SIZE(pages); i++)
+		__free_page(pages[i]);
+	dpu_test_file_free(&tf);
+}
+
+struct dpu_test_remap {
+	struct page *page;
+	struct dpu_compact_region *region;
+	struct dpu_fragment *frag;
+	struct folio *src, *dst;
+};
+
+/*
+ * 两个连续页：第 0 页是隔离到的空闲页，用作目标；第 1 页由调用者
+ * 放进 page cache 或 swap cache，再调用 dpu_test_remap_add()。
+ */
+static void dpu_test_remap_init(struct kunit *test, struct dpu_test_remap *tr)
+{
+	struct dpu_fragment *free;
+	unsigned long pfn;
+
+	tr->page = alloc_pages(GFP_KERNEL, 1);
+	KUNIT_ASSERT_NOT_NULL(test, tr->page);
+	split_page(tr->page, 1);
+	pfn = page_to_pfn(tr->page);
+	tr->dst = page_folio(tr->page);
+	tr->src = page_folio(tr->page + 1);
+
+	tr->region = dpu_test_region(test, ALIGN_DOWN(pfn, DPU_TEST_REGION_PAGES),
+				     DPU_TEST_REGION_PAGES);
+	free = dpu_test_add(test, tr->region, pfn - tr->region->base_pfn,
+			    false, false, NULL, MIGRATE_MOVABLE);
+	free->page = tr->page;
+}
+
+/* 第 1 页搬到第 0 页，数据已由 "DPU" 拷贝完成 */
+static void dpu_test_remap_add(struct kunit *test, struct dpu_test_remap *tr)
+{
+	struct dpu_compact_region *region = tr->region;
+	unsigned long pfn = page_to_pfn(tr->page);
+
+	tr->frag = dpu_test_add(test, region, pfn + 1 - region->base_pfn,
+				true, false, NULL, MIGRATE_MOVABLE);
+	tr->frag->page = tr->page + 1;
+	tr->frag->new_pfn = pfn;
+	set_bit(pfn - region->base_pfn, region->dst_map);
+
+	copy_highpage(tr->page, tr->page + 1);
+	region->state = DPU_COMPACT_MOVING;
+}
+
+/*
+ * 批量替换后、提交前：xarray 指向新页，index、mapping 和脏标记已转移，
+ * page cache 引用也转到了新页上。再拿一次源页引用观察提交后的状态。
+ */
+static void dpu_test_check_remapped(struct kunit *test,
+				    struct dpu_test_remap *tr,
+				    struct address_space *mapping, pgoff_t index)
+{
+	struct folio *src = tr->src, *dst = tr->dst;
+
+	dpu_compact_remap_batched(tr->region);
+	KUNIT_EXPECT_TRUE(test, tr->frag->fast_remap);
+	KUNIT_EXPECT_EQ(test, tr->region->nr_fast_remap, 1);
+
+	KUNIT_EXPECT_PTR_EQ(test, xa_load(&mapping->i_pages, index), (void *)dst);
+	KUNIT_EXPECT_EQ(test, folio_index(dst), index);
+	KUNIT_EXPECT_PTR_EQ(test, folio_mapping(dst), mapping);
+	KUNIT_EXPECT_TRUE(test, folio_test_dirty(dst));
+	KUNIT_EXPECT_FALSE(test, folio_test_dirty(src));
+	KUNIT_EXPECT_EQ(test, folio_ref_count(src), 1);
+	KUNIT_EXPECT_EQ(test, folio_ref_count(dst), 2);
+	KUNIT_EXPECT_TRUE(test, folio_test_locked(dst));
+
+	folio_get(src);
+	KUNIT_ASSERT_EQ(test, dpu_compact_update_mappings(tr->region), 0);
+	KUNIT_EXPECT_EQ(test, tr->region->state, DPU_COMPACT_COMPLETE);
+	KUNIT_EXPECT_EQ(test, tr->region->total_moved, 1);
+
+	/* 源页只剩测试的引用，释放时不能带着 mapping */
+	lru_add_drain_all();
+	KUNIT_EXPECT_NULL(test, src->mapping);
+	KUNIT_EXPECT_FALSE(test, folio_test_locked(src));
+	KUNIT_EXPECT_EQ(test, folio_ref_count(src), 1);
+	folio_put(src);
+
+	/* 新页只剩 page cache 的引用 */
+	KUNIT_EXPECT_FALSE(test, folio_test_locked(dst));
+	KUNIT_EXPECT_EQ(test, folio_ref_count(dst), 1);
+	KUNIT_EXPECT_EQ(test, *(u8 *)folio_address(dst), 0x5a);
+}
+
+static void dpu_compact_test_remap_pagecache(struct kunit *test)
+{
+	struct dpu_test_remap tr;
+	struct dpu_test_file tf;
+
+	dpu_test_file_init(test, &tf);
+	dpu_test_remap_init(test, &tr);
+	dpu_test_file_add(test, &tf, tr.page + 1, 7, 0x5a);
+	folio_mark_dirty(tr.src);
+	dpu_test_remap_add(test, &tr);
+
+	dpu_test_check_remapped(test, &tr, tf.mapping, 7);
+
+	dpu_test_region_free(tr.region);
+	dpu_test_file_free(&tf);
+}
+
+static void dpu_compact_test_remap_swapcache(struct kunit *test)
+{
+	struct address_space *mapping;
+	struct dpu_test_remap tr;
+	swp_entry_t entry;
+
+	if (!get_nr_swap_pages())
+		kunit_skip(test, "no swap");
+
+	dpu_test_remap_init(test, &tr);
+	memset(page_address(tr.page + 1), 0x5a, PAGE_SIZE);
+	__folio_set_locked(tr.src);
+	__folio_set_swapbacked(tr.src);
+	folio_mark_uptodate(tr.src);
+	if (!add_to_swap(tr.src)) {
+		folio_unlock(tr.src);
+		dpu_test_region_free(tr.region);
+		__free_page(tr.page);
+		__free_page(tr.page + 1);
+		kunit_skip(test, "swap is full");
+	}
+
+	/* 分配时的引用充当隔离引用 */
+	entry = folio_swap_entry(tr.src);
+	mapping = swap_address_space(entry);
+	dpu_test_remap_add(test, &tr);
+
+	dpu_test_check_remapped(test, &tr, mapping, swp_offset(entry));
+	KUNIT_EXPECT_TRUE(test, folio_test_swapcache(tr.dst));
+	KUNIT_EXPECT_TRUE(test, folio_test_swapbacked(tr.dst));
+	KUNIT_EXPECT_EQ(test, folio_swap_entry(tr.dst).val, entry.val);
+
+	/* 拿一次引用，从 swap cache 删掉后由它释放新页 */
+	folio_get(tr.dst);
+	folio_lock(tr.dst);
+	delete_from_swap_cache(tr.dst);
+	folio_unlock(tr.dst);
+	folio_put(tr.dst);
+
+	dpu_test_region_free(tr.region);
+}
+
+/*
+ * 有人多拿了源页的引用，批量路径冻结失败，改走 folio_migrate_mapping()，
+ * 它同样因引用计数不符失败：回退这个碎片，xarray 仍指向源页。
+ */
+static void dpu_compact_test_remap_freeze_fails(struct kunit *test)
+{
+	struct dpu_test_remap tr;
+	struct dpu_test_file tf;
+	struct folio *src;
+
+	dpu_test_file_init(test, &tf);
+	dpu_test_remap_init(test, &tr);
+	src = dpu_test_file_add(test, &tf, tr.page + 1, 7, 0x5a);
+	dpu_test_remap_add(test, &tr);
+	folio_get(src);
+
+	KUNIT_ASSERT_EQ(test, dpu_compact_update_mappings(tr.region), 0);
+	KUNIT_EXPECT_FALSE(test, tr.frag->fast_remap);
+	KUNIT_EXPECT_EQ(test, tr.region->nr_fast_remap, 0);
+	KUNIT_EXPECT_EQ(test, tr.region->state, DPU_COMPACT_PARTIAL);
+	KUNIT_EXPECT_EQ(test, tr.region->nr_copy_failed, 1);
+	KUNIT_EXPECT_EQ(test, tr.region->total_moved, 0);
+	KUNIT_EXPECT_FALSE(test, test_bit(page_to_pfn(tr.page) - tr.region->base_pfn,
+					  tr.region->dst_map));
+
+	/* 源页回到 LRU，page cache 和测试各一次引用 */
+	lru_add_drain_all();
+	KUNIT_EXPECT_PTR_EQ(test, xa_load(&tf.mapping->i_pages, 7), (void *)src);
+	KUNIT_EXPECT_PTR_EQ(test, src->mapping, tf.mapping);
+	KUNIT_EXPECT_FALSE(test, folio_test_locked(src));
+	KUNIT_EXPECT_TRUE(test, folio_test_lru(src));
+	KUNIT_EXPECT_EQ(test, folio_ref_count(src), 2);
+	folio_put(src);
+
+	dpu_test_region_free(tr.region);
+	dpu_test_file_free(&tf);
+}
+
+/* --- Buddy 页拆分 --- */
+
+/* 释放一个大于 pcp 缓存 order 的块，返回它在 buddy 中合并后的头页 */
+static struct page *dpu_test_free_buddy(struct kunit *test, unsigned long *nr)
+{
+	const unsigned int order = PAGE_ALLOC_COSTLY_ORDER + 1;
+	struct page *page;
+	unsigned long pfn;
+	unsigned int o;
+
+	page = alloc_pages(GFP_KERNEL, order);
+	KUNIT_ASSERT_NOT_NULL(test, page);
+	pfn = page_to_pfn(page);
+	__free_pages(page, order);
+
+	/* 可能已与相邻 buddy 合并，找到合并后的头页 */
+	for (o = order; o < MAX_ORDER; o++) {
+		page = pfn_to_page(ALIGN_DOWN(pfn, 1UL << o));
+		if (PageBuddy(page) && buddy_order(page) >= o) {
+			*nr = 1UL << buddy_order(page);
+			return page;
+		}
+	}
+
+	kunit_skip(test, "page was reallocated before isolation");
+	return NULL;
+}
+
+/*
+ * 检查 dpu_compact_isolate_buddy_page() 取到的子页：都在 [lo, hi) 内、
+ * 未加锁、只持有拆分时的一次引用，然后释放。
+ */
+static void dpu_test_check_buddy(struct kunit *test,
+				 struct dpu_compact_region *region,
+				 unsigned long lo, unsigned long hi)
+{
+	struct dpu_fragment *frag;
+
+	list_for_each_entry(frag, &region->fragments, list) {
+		KUNIT_EXPECT_FALSE(test, frag->is_frag);
+		KUNIT_EXPECT_GE(test, frag->old_pfn, lo);
+		KUNIT_EXPECT_LT(test, frag->old_pfn, hi);
+		KUNIT_EXPECT_EQ(test, page_ref_count(frag->page), 1);
+		KUNIT_EXPECT_FALSE(test, PageBuddy(frag->page));
+		KUNIT_EXPECT_FALSE(test, PageLocked(frag->page));
+		__free_page(frag->page);
+	}
+}
+
+static void dpu_compact_test_isolate_buddy_split(struct kunit *test)
+{
+	const unsigned long room = 8;
+	struct dpu_compact_region *region;
+	unsigned long pfn, base, nr = 0, taken;
+	struct page *page;
+
+	page = dpu_test_free_buddy(test, &nr);
+	pfn = page_to_pfn(page);
+	base = ALIGN_DOWN(pfn, DPU_TEST_REGION_PAGES);
+
+	region = dpu_test_region(test, base, DPU_TEST_REGION_PAGES);
+	region->nr_fragments = DPU_MAX_FRAGMENTS - room;
+
+	taken = dpu_compact_isolate_buddy_page(region, page);
+	if (!taken) {
+		dpu_test_region_free(region);
+		kunit_skip(test, "buddy page could not be isolated");
+	}
+
+	/* 只取 room 个子页，其余的应已放回 buddy */
+	KUNIT_EXPECT_EQ(test, taken, min(nr, room));
+	KUNIT_EXPECT_EQ(test, region->nr_fragments, DPU_MAX_FRAGMENTS);
+	dpu_test_check_buddy(test, region, max(pfn, base),
+			     min(pfn + nr, base + DPU_TEST_REGION_PAGES));
+
+	dpu_test_region_free(region);
+}
+
+static void dpu_compact_test_isolate_buddy_clamp(struct kunit *test)
+{
+	const unsigned long size = 4;
+	struct dpu_compact_region *region;
+	unsigned long pfn, nr = 0, taken;
+	struct page *page;
+
+	/* 区域只有 4 页，buddy 块至少 16 页，超出区域的子页不能取 */
+	page = dpu_test_free_buddy(test, &nr);
+	pfn = page_to_pfn(page);
+
+	region = dpu_test_region(test, pfn, size);
+
+	taken = dpu_compact_isolate_buddy_page(region, page);
+	if (!taken) {
+		dpu_test_region_free(region);
+		kunit_skip(test, "buddy page could not be isolated");
+	}
+
+	KUNIT_EXPECT_EQ(test, taken, size);
+	KUNIT_EXPECT_EQ(test, region->nr_fragments, size);
+	KUNIT_EXPECT_EQ(test, dpu_compact_plan(region), 0);
+	dpu_test_check_buddy(test, region, pfn, pfn + size);
+
+	dpu_test_region_free(region);
+}
+
+/* --- 状态转换 --- */
+
+static void dpu_compact_test_state_rejects(struct kunit *test)
+{
+	struct dpu_compact_region *region;
+
+	region = dpu_test_region(test, DPU_TEST_BASE_PFN, DPU_TEST_REGION_PAGES);
+
+	/* COLLECTING 但没有碎片 */
+	KUNIT_EXPECT_EQ(test, dpu_compact_execute(region), -EINVAL);
+	KUNIT_EXPECT_EQ(test, region->state, DPU_COMPACT_COLLECTING);
+
+	/* 未经 MOVING 不能更新映射 */
+	KUNIT_EXPECT_EQ(test, dpu_compact_update_mappings(region), -EINVAL);
+	KUNIT_EXPECT_EQ(test, region->state, DPU_COMPACT_COLLECTING);
+
+	dpu_test_add_layout(test, region, "F.");
+	region->state = DPU_COMPACT_IDLE;
+	KUNIT_EXPECT_EQ(test, dpu_compact_execute(region), -EINVAL);
+	KUNIT_EXPECT_EQ(test, region->state, DPU_COMPACT_IDLE);
+
+	dpu_test_region_free(region);
+}
+
+static void dpu_compact_test_state_free_only(struct kunit *test)
+{
+	struct dpu_compact_region *region;
+	unsigned long pfn, nr = 0;
+	struct page *page;
+
+	/* 与生产路径一样，空闲页经 dpu_compact_isolate_buddy_page() 取得 */
+	page = dpu_test_free_buddy(test, &nr);
+	pfn = page_to_pfn(page);
+
+	region = dpu_test_region(test, ALIGN_DOWN(pfn, DPU_TEST_REGION_PAGES),
+				 DPU_TEST_REGION_PAGES);
+	if (!dpu_compact_isolate_buddy_page(region, page)) {
+		dpu_test_region_free(region);
+		kunit_skip(test, "buddy page could not be isolated");
+	}
+
+	/* 只有空闲页：COLLECTING -> MOVING -> COMPLETE，页面全部放回 buddy */
+	KUNIT_EXPECT_EQ(test, dpu_compact_execute(region), 0);
+	KUNIT_EXPECT_EQ(test, region->state, DPU_COMPACT_MOVING);
+	KUNIT_EXPECT_EQ(test, region->nr_copy_failed, 0);
+
+	KUNIT_EXPECT_EQ(test, dpu_compact_update_mappings(region), 0);
+	KUNIT_EXPECT_EQ(test, region->state, DPU_COMPACT_COMPLETE);
+	KUNIT_EXPECT_EQ(test, region->total_moved, 0);
+
+	dpu_test_region_free(region);
+}
+
+/* --- try_dpu_compact_zone() 决策表 --- */
+
+struct dpu_hook_case {
+	const char *desc;
+	int enabled;
+	int order_delta;	/* 相对 pageblock_order */
+	gfp_t gfp_mask;
+	int compact_ret;	/* dpu_compact_memory() 桩的返回值 */
+	enum compact_result expected;
+	bool calls_compact;
+};
+
+static const struct dpu_hook_case dpu_hook_cases[] = {
+	{ "disabled", 0, 0, GFP_KERNEL, COMPACT_SUCCESS, COMPACT_SKIPPED, false },
+	{ "low order", 1, -1, GFP_KERNEL, COMPACT_SUCCESS, COMPACT_SKIPPED, false },
+	{ "atomic", 1, 0, GFP_ATOMIC, COMPACT_SUCCESS, COMPACT_SKIPPED, false },
+	{ "success", 1, 0, GFP_KERNEL, COMPACT_SUCCESS, COMPACT_SUCCESS, true },
+	{ "partial", 1, 0, GFP_KERNEL, COMPACT_PARTIAL_SKIPPED, COMPACT_PARTIAL_SKIPPED, true },
+	{ "failed", 1, 1, GFP_KERNEL, COMPACT_FAILED, COMPACT_FAILED, true },
+};
+
+static void dpu_hook_case_desc(const struct dpu_hook_case *c, char *desc)
+{
+	strscpy(desc, c->desc, KUNIT_PARAM_DESC_SIZE);
+}
+
+KUNIT_ARRAY_PARAM(dpu_hook, dpu_hook_cases, dpu_hook_case_desc);
+
+static int dpu_test_compact_ret;
+static unsigned int dpu_test_compact_calls;
+
+static int dpu_test_compact_memory(struct zone *zone, unsigned int order)
+{
+	dpu_test_compact_calls++;
+	return dpu_test_compact_ret;
+}
+
+static void dpu_compact_test_hook_decision(struct kunit *test)
+{
+	const struct dpu_hook_case *c = test->param_value;
+	int saved = sysctl_dpu_compact_enabled;
+	struct zone *zone;
+	void *buf;
+
+	buf = kunit_kzalloc(test, 64, GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, buf);
+	zone = page_zone(virt_to_page(buf));
+
+	dpu_test_compact_ret = c->compact_ret;
+	dpu_test_compact_calls = 0;
+	kunit_activate_static_stub(test, dpu_compact_memory, dpu_test_compact_memory);
+
+	sysctl_dpu_compact_enabled = c->enabled;
+	KUNIT_EXPECT_EQ(test, try_dpu_compact_zone(zone, pageblock_order + c->order_delta,
+						   c->gfp_mask), c->expected);
+	sysctl_dpu_compact_enabled = saved;
+
+	KUNIT_EXPECT_EQ(test, dpu_test_compact_calls, c->calls_compact ? 1 : 0);
+}
+
+static struct kunit_case dpu_compact_test_cases[] = {
+	KUNIT_CASE(dpu_compact_test_plan_alternating),
+	KUNIT_CASE(dpu_compact_test_plan_already_packed),
+	KUNIT_CASE(dpu_compact_test_plan_reversed),
+	KUNIT_CASE(dpu_compact_test_plan_skips_unmovable),
+	KUNIT_CASE(dpu_compact_test_plan_cold_before_hot),
+	KUNIT_CASE(dpu_compact_test_plan_groups_owner),
+	KUNIT_CASE(dpu_compact_test_retry_on_cpu),
+	KUNIT_CASE(dpu_compact_test_execute_commit),
+	KUNIT_CASE(dpu_compact_test_commit_rollback),
+	KUNIT_CASE(dpu_compact_test_drop_clean),
+	KUNIT_CASE(dpu_compact_test_drop_skips),
+	KUNIT_CASE(dpu_compact_test_drop_replan),
+	KUNIT_CASE(dpu_compact_test_remap_pagecache),
+	KUNIT_CASE(dpu_compact_test_remap_swapcache),
+	KUNIT_CASE(dpu_compact_test_remap_freeze_fails),
+	KUNIT_CASE(dpu_compact_test_isolate_buddy_split),
+	KUNIT_CASE(dpu_compact_test_isolate_buddy_clamp),
+	KUNIT_CASE(dpu_compact_test_state_rejects),
+	KUNIT_CASE(dpu_compact_test_state_free_only),
+	KUNIT_CASE_PARAM(dpu_compact_test_hook_decision, dpu_hook_gen_params),
+	{}
+};
+
+static struct kunit_suite dpu_compact_test_suite = {
+	.name = "dpu_compact",
+	.test_cases = dpu_compact_test_cases,
+};
+
+/* --- 微基准与性能门限 --- */
+
+static const unsigned int dpu_bench_sizes[] = { 512, 768, 1024 };
+
+static void dpu_bench_size_desc(const unsigned int *nr, char *desc)
+{
+	snprintf(desc, KUNIT_PARAM_DESC_SIZE, "%u fragments", *nr);
+}
+
+KUNIT_ARRAY_PARAM(dpu_bench_plan, dpu_bench_sizes, dpu_bench_size_desc);
+
+static void dpu_compact_bench_plan(struct kunit *test)
+{
+	static char owners[4];
+	const unsigned int nr = *(const unsigned int *)test->param_value;
+	struct dpu_compact_region *region;
+	u64 start, elapsed, avg;
+	unsigned long i;
+	int loop;
+
+	/* 最坏布局：空闲页与碎片交替，冷热混合，多个 owner 交错 */
+	region = dpu_test_region(test, DPU_TEST_BASE_PFN, nr);
+	for (i = 0; i < nr; i++)
+		dpu_test_add(test, region, i, i & 1, (i & 7) == 7,
+			     &owners[(i >> 1) & 3], MIGRATE_MOVABLE);
+
+	start = ktime_get_ns();
+	for (loop = 0; loop < DPU_TEST_BENCH_LOOPS; loop++)
+		KUNIT_ASSERT_EQ(test, dpu_compact_plan(region), 0);
+	elapsed = ktime_get_ns() - start;
+	avg = div_u64(elapsed, DPU_TEST_BENCH_LOOPS);
+
+	kunit_info(test, "plan %u fragments: %llu ns/iter\n", nr, avg);
+	/* 交替布局只需把后一半的碎片搬进前一半的空闲页 */
+	KUNIT_EXPECT_EQ(test, dpu_test_check_plan(test, region, true), nr / 4);
+	KUNIT_EXPECT_LT(test, avg, DPU_TEST_PLAN_BUDGET_NS);
+
+	dpu_test_region_free(region);
+}
+
+static void dpu_compact_bench_isolate(struct kunit *test)
+{
+	const unsigned int order = ilog2(DPU_TEST_REGION_PAGES);
+	struct dpu_compact_region *region;
+	struct dpu_fragment *frag;
+	struct page *page;
+	unsigned long pfn, i;
+	const int expected = DPU_TEST_REGION_PAGES / 2;
+	u64 start, elapsed;
+	int isolated;
+	bool raced;
+
+	page = alloc_pages(GFP_KERNEL | __GFP_NOWARN, order);
+	if (!page)
+		kunit_skip(test, "no free %lu-page block", DPU_TEST_REGION_PAGES);
+	split_page(page, order);
+	pfn = page_to_pfn(page);
+
+	/* 隔一页释放一页，得到完全碎片化的区域 */
+	for (i = 1; i < DPU_TEST_REGION_PAGES; i += 2)
+		__free_page(page + i);
+	drain_all_pages(page_zone(page));
+
+	region = dpu_test_region(test, pfn, DPU_TEST_REGION_PAGES);
+
+	start = ktime_get_ns();
+	isolated = dpu_compact_isolate_pages(page_zone(page), region, pfn,
+					     pfn + DPU_TEST_REGION_PAGES);
+	elapsed = ktime_get_ns() - start;
+
+	kunit_info(test, "isolate %d of %d free pages: %llu ns\n",
+		   isolated, expected, elapsed);
+	KUNIT_EXPECT_GT(test, isolated, 0);
+	KUNIT_EXPECT_LE(test, isolated, expected);
+	KUNIT_EXPECT_EQ(test, region->nr_fragments, isolated);
+
+	/* 其他 CPU 抢走了较多刚释放的页，耗时没有可比性 */
+	raced = isolated > 0 && isolated < expected * 7 / 8;
+	if (!raced)
+		KUNIT_EXPECT_LT(test, elapsed, DPU_TEST_ISOLATE_BUDGET_NS);
+
+	list_for_each_entry(frag, &region->fragments, list)
+		__free_page(frag->page);
+	dpu_test_region_free(region);
+
+	for (i = 0; i < DPU_TEST_REGION_PAGES; i += 2)
+		__free_page(page + i);
+
+	if (raced)
+		kunit_skip(test, "only %d of %d free pages left to isolate",
+			   isolated, expected);
+}
+
+static struct kunit_case dpu_compact_bench_cases[] = {
+	KUNIT_CASE_PARAM(dpu_compact_bench_plan, dpu_bench_plan_gen_params),
+	KUNIT_CASE(dpu_compact_bench_isolate),
+	{}
+};
+
+static struct kunit_suite dpu_compact_bench_suite = {
+	.name = "dpu_compact_bench",
+	.test_cases = dpu_compact_bench_cases,
+};
+
+kunit_test_suites(&dpu_compact_test_suite, &dpu_compact_bench_suite);
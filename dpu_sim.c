@@ -1,11 +1,17 @@
 #include "dpu_compact.h"
-static int dpu_hw_compact_execute(struct dpu_compact_region *region)
+static int dpu_hw_memory_move(unsigned long *src_pfn_list,
+			      unsigned long *dst_pfn_list,
+			      int *status, int count);
+
+int dpu_hw_compact_execute(struct dpu_compact_region *region)
 {
 	struct dpu_fragment *frag;
 	int migrated = 0;
 	int ret;
 	unsigned long *src_pfn_list;
 	unsigned long *dst_pfn_list;
+	struct dpu_fragment **frag_list;
+	int *status;
 	int nr_migrations = 0;
 	int i = 0;
 
@@ -24,10 +30,14 @@ static int dpu_hw_compact_execute(struct dpu_compact_region *region)
 	/* 分配源和目标PFN数组 */
 	src_pfn_list = kmalloc_array(nr_migrations, sizeof(unsigned long), GFP_KERNEL);
 	dst_pfn_list = kmalloc_array(nr_migrations, sizeof(unsigned long), GFP_KERNEL);
+	frag_list = kmalloc_array(nr_migrations, sizeof(*frag_list), GFP_KERNEL);
+	status = kmalloc_array(nr_migrations, sizeof(int), GFP_KERNEL);
 	
-	if (!src_pfn_list || !dst_pfn_list) {
+	if (!src_pfn_list || !dst_pfn_list || !frag_list || !status) {
 		kfree(src_pfn_list);
 		kfree(dst_pfn_list);
+		kfree(frag_list);
+		kfree(status);
 		return -ENOMEM;
 	}
 
@@ -37,6 +47,7 @@ static int dpu_hw_compact_execute(struct dpu_compact_region *region)
 		if (frag->is_frag && frag->old_pfn != frag->new_pfn) {
 			src_pfn_list[i] = frag->old_pfn;
 			dst_pfn_list[i] = frag->new_pfn;
+			frag_list[i] = frag;
 			i++;
 			
 			pr_debug("DPU compact: Plan to migrate PFN %lu -> %lu\n",
@@ -45,28 +56,44 @@ static int dpu_hw_compact_execute(struct dpu_compact_region *region)
 	}
 
 	/* 调用DPU硬件执行迁移 */
-	ret = dpu_hw_memory_move(src_pfn_list, dst_pfn_list, nr_migrations);
+	ret = dpu_hw_memory_move(src_pfn_list, dst_pfn_list, status, nr_migrations);
 	
 	if (ret < 0) {
 		pr_err("DPU compact: Hardware migration failed with error %d\n", ret);
-		kfree(src_pfn_list);
-		kfree(dst_pfn_list);
-		return ret;
+		goto out;
 	}
 
-	migrated = ret;
-	pr_info("DPU compact: Successfully migrated %d pages\n", migrated);
+	/* 回写每个描述符的完成状态，失败的由上层单独回退或重试 */
+	for (i = 0; i < nr_migrations; i++)
+		frag_list[i]->copy_status = status[i];
 
+	migrated = ret;
+	if (migrated < nr_migrations)
+		pr_warn("DPU compact: %d of %d descriptors failed\n",
+			nr_migrations - migrated, nr_migrations);
+	else
+		pr_info("DPU compact: Successfully migrated %d pages\n", migrated);
+	ret = migrated;
+
+out:
 	kfree(src_pfn_list);
 	kfree(dst_pfn_list);
+	kfree(frag_list);
+	kfree(status);
 
-	return migrated;
+	return ret;
 }
 
 
+/*
+ * 按顺序执行描述符，status[i] 记录每个描述符的结果：
+ *   0        拷贝完成
+ *   -EFAULT  PFN 无效，未拷贝
+ * 返回成功拷贝的描述符数量。
+ */
 static int dpu_hw_memory_move(unsigned long *src_pfn_list,
 			      unsigned long *dst_pfn_list,
-			      int count)
+			      int *status, int count)
 {
 	int i, migrated = 0;
 
@@ -74,9 +101,13 @@ static int dpu_hw_memory_move(unsigned long *src_pfn_list,
 		struct page *src_page, *dst_page;
 		void *src, *dst;
 
+		status[i] = 0;
+
 		/* 验证并获取page */
-		if (!pfn_valid(src_pfn_list[i]) || !pfn_valid(dst_pfn_list[i]))
+		if (!pfn_valid(src_pfn_list[i]) || !pfn_valid(dst_pfn_list[i])) {
+			status[i] = -EFAULT;
 			continue;
+		}
 
 		src_page = pfn_to_page(src_pfn_list[i]);
 		dst_page = pfn_to_page(dst_pfn_list[i]);